@@ -117,11 +117,12 @@ void serverTask(void *params) {
 
     // "loop()" function of the separate task
     while(true) {
-      // This call will let the server do its work
-      secureServer.loop();
+      // This call will let the server do its work. As we run in a separate task,
+      // we can let the server wait up to 1000ms for new requests. It returns
+      // earlier if there is something to do, so we do not need to call delay().
+      secureServer.loop(1000);
 
       // Other code would go here...
-      delay(1);
     }
   }
 }
@@ -29,7 +29,9 @@
  *
  * This script will install an HTTPS Server on your ESP32 with the following
  * functionalities:
- *  - Serve static files from the SPIFFS's data/public directory
+ *  - Serve static files from the SPIFFS's data/public directory. Precompressed
+ *    variants (like script.js.gz) are used if available, and browsers can
+ *    cache the files
  *  - Provide a REST API at /api to receive the asynchronous http requests
  *    - /api/uptime provides access to the current system uptime
  *    - /api/events allows to register or delete events to turn PINs on/off
@@ -59,30 +61,18 @@
 // Define the name of the directory for public files in the SPIFFS parition
 #define DIR_PUBLIC "/public"
 
-// We need to specify some content-type mapping, so the resources get delivered with the
-// right content type and are displayed correctly in the browser
-char contentTypes[][2][32] = {
-  {".html", "text/html"},
-  {".css",  "text/css"},
-  {".js",   "application/javascript"},
-  {".json", "application/json"},
-  {".png",  "image/png"},
-  {".jpg",  "image/jpg"},
-  {"", ""}
-};
-
 // Includes for the server
 #include <HTTPSServer.hpp>
 #include <SSLCert.hpp>
 #include <HTTPRequest.hpp>
 #include <HTTPResponse.hpp>
-#include <util.hpp>
+#include <StaticFileNode.hpp>
+#include <ArduinoStaticFileSystem.hpp>
 
 // The HTTPS Server comes in a separate namespace. For easier use, include it here.
 using namespace httpsserver;
 
 SSLCert * getCertificate();
-void handleSPIFFS(HTTPRequest * req, HTTPResponse * res);
 void handleGetUptime(HTTPRequest * req, HTTPResponse * res);
 void handleGetEvents(HTTPRequest * req, HTTPResponse * res);
 void handlePostEvent(HTTPRequest * req, HTTPResponse * res);
@@ -164,9 +154,10 @@ void setup() {
   // Create the server with the certificate we loaded before
   secureServer = new HTTPSServer(cert);
 
-  // We register the SPIFFS handler as the default node, so every request that does
-  // not hit any other node will be redirected to the file system.
-  ResourceNode * spiffsNode = new ResourceNode("", "", &handleSPIFFS);
+  // We register a StaticFileNode as the default node, so every request that does
+  // not hit any other node will be redirected to the file system. The node takes care
+  // of content types, caching headers, compression and range requests.
+  StaticFileNode * spiffsNode = new StaticFileNode("", new ArduinoStaticFileSystem(SPIFFS, DIR_PUBLIC));
   secureServer->setDefaultNode(spiffsNode);
 
   // Add a handler that serves the current system uptime at GET /api/uptime
@@ -297,64 +288,6 @@ SSLCert * getCertificate() {
   }
 }
 
-/**
- * This handler function will try to load the requested resource from SPIFFS's /public folder.
- * 
- * If the method is not GET, it will throw 405, if the file is not found, it will throw 404.
- */
-void handleSPIFFS(HTTPRequest * req, HTTPResponse * res) {
-	
-  // We only handle GET here
-  if (req->getMethod() == "GET") {
-    // Redirect / to /index.html
-    std::string reqFile = req->getRequestString()=="/" ? "/index.html" : req->getRequestString();
-
-    // Try to open the file
-    std::string filename = std::string(DIR_PUBLIC) + reqFile;
-
-    // Check if the file exists
-    if (!SPIFFS.exists(filename.c_str())) {
-      // Send "404 Not Found" as response, as the file doesn't seem to exist
-      res->setStatusCode(404);
-      res->setStatusText("Not found");
-      res->println("404 Not Found");
-      return;
-    }
-
-    File file = SPIFFS.open(filename.c_str());
-
-    // Set length
-    res->setHeader("Content-Length", httpsserver::intToString(file.size()));
-
-    // Content-Type is guessed using the definition of the contentTypes-table defined above
-    int cTypeIdx = 0;
-    do {
-      if(reqFile.rfind(contentTypes[cTypeIdx][0])!=std::string::npos) {
-        res->setHeader("Content-Type", contentTypes[cTypeIdx][1]);
-        break;
-      }
-      cTypeIdx+=1;
-    } while(strlen(contentTypes[cTypeIdx][0])>0);
-
-    // Read the file and write it to the response
-    uint8_t buffer[256];
-    size_t length = 0;
-    do {
-      length = file.read(buffer, 256);
-      res->write(buffer, length);
-    } while (length > 0);
-
-    file.close();
-  } else {
-    // If there's any body, discard it
-    req->discardRequestBody();
-    // Send "405 Method not allowed" as response
-    res->setStatusCode(405);
-    res->setStatusText("Method not allowed");
-    res->println("405 Method not allowed");
-  }
-}
-
 /**
  * This function will return the uptime in seconds as JSON object:
  * {"uptime": 42}
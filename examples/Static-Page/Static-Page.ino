@@ -11,6 +11,7 @@
  * This script will install an HTTPS Server on your ESP32 with the following
  * functionalities:
  *  - Show simple page on web server root
+ *  - Serve the favicon from flash
  *  - 404 for everything else
  */
 
@@ -121,10 +122,12 @@ void handleRoot(HTTPRequest * req, HTTPResponse * res) {
 }
 
 void handleFavicon(HTTPRequest * req, HTTPResponse * res) {
-  // Set Content-Type
-  res->setHeader("Content-Type", "image/vnd.microsoft.icon");
-  // Write data from header file
-  res->write(FAVICON_DATA, FAVICON_LENGTH);
+  // Send the data from the header file. As the length is known in advance, it is sent directly
+  // from flash without being buffered, and the connection can be kept alive.
+  // The ETag allows the browser to cache the icon: If it asks for the same version again, the
+  // server only answers with 304 Not Modified. Change it when you update the data.
+  // (If you do not need a handler function, you can also register a StaticResourceNode)
+  res->sendStatic(FAVICON_DATA, FAVICON_LENGTH, "image/vnd.microsoft.icon", "favicon-1");
 }
 
 void handle404(HTTPRequest * req, HTTPResponse * res) {
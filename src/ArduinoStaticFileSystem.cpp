@@ -0,0 +1,62 @@
+#include "ArduinoStaticFileSystem.hpp"
+
+namespace httpsserver {
+
+/**
+ * \brief File of an ArduinoStaticFileSystem
+ */
+class ArduinoStaticFile : public StaticFile {
+public:
+  ArduinoStaticFile(fs::File file):
+    _file(file) {
+
+  }
+
+  virtual ~ArduinoStaticFile() {
+    _file.close();
+  }
+
+  virtual size_t read(byte * buffer, size_t length) {
+    return _file.read(buffer, length);
+  }
+
+  virtual bool seek(size_t position) {
+    return _file.seek(position, fs::SeekSet);
+  }
+
+  virtual size_t size() {
+    return _file.size();
+  }
+
+  virtual time_t getLastModified() {
+    return _file.getLastWrite();
+  }
+
+private:
+  fs::File _file;
+};
+
+ArduinoStaticFileSystem::ArduinoStaticFileSystem(fs::FS &fileSystem, std::string const &rootDirectory):
+  _fileSystem(fileSystem),
+  _rootDirectory(rootDirectory) {
+
+}
+
+ArduinoStaticFileSystem::~ArduinoStaticFileSystem() {
+
+}
+
+StaticFile * ArduinoStaticFileSystem::open(std::string const &path) {
+  std::string fullPath = _rootDirectory + path;
+  // Check first, as opening a missing file logs an error on some file systems
+  if (!_fileSystem.exists(fullPath.c_str())) {
+    return NULL;
+  }
+  fs::File file = _fileSystem.open(fullPath.c_str(), "r");
+  if (!file || file.isDirectory()) {
+    return NULL;
+  }
+  return new ArduinoStaticFile(file);
+}
+
+} /* namespace httpsserver */
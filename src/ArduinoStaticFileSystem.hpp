@@ -0,0 +1,32 @@
+#ifndef SRC_ARDUINOSTATICFILESYSTEM_HPP_
+#define SRC_ARDUINOSTATICFILESYSTEM_HPP_
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <string>
+
+#include "StaticFileSystem.hpp"
+
+namespace httpsserver {
+
+/**
+ * \brief StaticFileSystem for the file systems of the Arduino core, like SPIFFS, LittleFS or SD
+ *
+ * Example: new ArduinoStaticFileSystem(SPIFFS, "/public")
+ */
+class ArduinoStaticFileSystem : public StaticFileSystem {
+public:
+  ArduinoStaticFileSystem(fs::FS &fileSystem, std::string const &rootDirectory = "");
+  virtual ~ArduinoStaticFileSystem();
+
+  virtual StaticFile * open(std::string const &path);
+
+private:
+  fs::FS &_fileSystem;
+  const std::string _rootDirectory;
+};
+
+} /* namespace httpsserver */
+
+#endif /* SRC_ARDUINOSTATICFILESYSTEM_HPP_ */
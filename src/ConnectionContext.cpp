@@ -10,6 +10,20 @@ ConnectionContext::~ConnectionContext() {
 	
 }
 
+/**
+ * Writes two buffers (e.g. the header block and the first part of the body) to the connection.
+ *
+ * Implementations should send them in as few packets as possible. This default implementation
+ * writes them one after the other.
+ */
+size_t ConnectionContext::writeBuffers(byte* head, size_t headLength, byte* body, size_t bodyLength) {
+  size_t written = writeBuffer(head, headLength);
+  if (bodyLength > 0) {
+    written += writeBuffer(body, bodyLength);
+  }
+  return written;
+}
+
 void ConnectionContext::setWebsocketHandler(WebsocketHandler *wsHandler) {
   _wsHandler = wsHandler;
 }
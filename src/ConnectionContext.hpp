@@ -4,9 +4,8 @@
 #include <Arduino.h>
 #include <IPAddress.h>
 
-// Required for SSL
-#include "openssl/ssl.h"
-#undef read
+#include "RequestArena.hpp"
+#include "DeflateEncoder.hpp"
 
 namespace httpsserver {
 
@@ -23,13 +22,25 @@ public:
   virtual void signalRequestError() = 0;
   virtual void signalClientClose() = 0;
   virtual size_t getCacheSize() = 0;
+  virtual byte * getResponseBuffer() = 0;
+  virtual RequestArena * getRequestArena() = 0;
+  virtual DeflateEncoder * getDeflateEncoder() = 0;
 
   virtual size_t readBuffer(byte* buffer, size_t length) = 0;
   virtual size_t pendingBufferSize() = 0;
+  virtual bool isInputClosed() = 0;
+  virtual const char * getBufferedData() = 0;
+  virtual size_t getBufferedLength() = 0;
+  virtual void consumeBuffer(size_t length) = 0;
 
   virtual size_t writeBuffer(byte* buffer, size_t length) = 0;
+  virtual size_t writeBuffers(byte* head, size_t headLength, byte* body, size_t bodyLength);
+  virtual size_t getSendQueueSize() = 0;
+  virtual size_t getSendQueueHighWaterMark() = 0;
 
   virtual bool isSecure() = 0;
+  virtual bool isKeepAlive() = 0;
+  virtual bool supportsChunkedEncoding() = 0;
   virtual void setWebsocketHandler(WebsocketHandler *wsHandler);
   virtual IPAddress getClientIP() = 0;
 
@@ -0,0 +1,389 @@
+#include "DeflateEncoder.hpp"
+
+#include <cstring>
+#include <new>
+// Arduino declares it's own min max, incompatible with the stl...
+#undef min
+#undef max
+#include <algorithm>
+
+namespace httpsserver {
+
+static const size_t WINDOW_SIZE = HTTPS_DEFLATE_WINDOW_SIZE;
+// Positions in the window are stored as uint16_t, and a match must fit into the data that remains
+// in the window when it is slid
+static_assert((WINDOW_SIZE & (WINDOW_SIZE - 1)) == 0 && WINDOW_SIZE >= 512 && WINDOW_SIZE <= 32768,
+  "HTTPS_DEFLATE_WINDOW_SIZE must be a power of two between 512 and 32768");
+
+static const size_t HASH_BITS = 10;
+static const size_t HASH_SIZE = 1 << HASH_BITS;
+static const size_t MIN_MATCH = 3;
+static const size_t MAX_MATCH = 258;
+// Number of positions that are compared to find a match. Higher values compress better, but slower
+static const size_t MAX_CHAIN = 8;
+// Space that is kept free in the output buffer for one symbol or the end of the stream
+static const size_t OUTPUT_RESERVE = 16;
+
+// Length codes 257..285 and distance codes 0..29 (RFC 1951, 3.2.5)
+static const uint16_t LENGTH_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LENGTH_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DISTANCE_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+  4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DISTANCE_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// CRC-32 (as used by gzip), processed in steps of 4 bits to keep the table small
+static const uint32_t CRC32_TABLE[16] = {
+  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+// Multiplicative hash of the next MIN_MATCH bytes
+static inline size_t hashBytes(const byte * data) {
+  return ((((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+DeflateEncoder::DeflateEncoder() {
+  _format = FORMAT_GZIP;
+  _window = NULL;
+  _head = NULL;
+  _prev = NULL;
+  _pos = 0;
+  _end = 0;
+  _outputLength = 0;
+  _bitBuffer = 0;
+  _bitCount = 0;
+  _checksum = 0;
+  _inputLength = 0;
+  _finished = true;
+}
+
+DeflateEncoder::~DeflateEncoder() {
+  if (_window != NULL) {
+    delete[] _window;
+    delete[] _head;
+    delete[] _prev;
+  }
+}
+
+/**
+ * Starts a new stream and writes its header to the output. Returns false if the memory for the
+ * window could not be allocated.
+ */
+bool DeflateEncoder::begin(Format format) {
+  if (_window == NULL) {
+    _window = new (std::nothrow) byte[2 * WINDOW_SIZE];
+    _head = new (std::nothrow) uint16_t[HASH_SIZE];
+    _prev = new (std::nothrow) uint16_t[WINDOW_SIZE];
+    if (_window == NULL || _head == NULL || _prev == NULL) {
+      HTTPS_LOGE("Not enough memory for the deflate window");
+      delete[] _window;
+      delete[] _head;
+      delete[] _prev;
+      _window = NULL;
+      return false;
+    }
+  }
+  memset(_head, 0, HASH_SIZE * sizeof(uint16_t));
+  memset(_prev, 0, WINDOW_SIZE * sizeof(uint16_t));
+  _format = format;
+  _pos = 0;
+  _end = 0;
+  _outputLength = 0;
+  _bitBuffer = 0;
+  _bitCount = 0;
+  _inputLength = 0;
+  _finished = false;
+
+  if (_format == FORMAT_GZIP) {
+    // Magic number, compression method deflate, no flags, no modification time, no extra flags, unknown OS
+    static const byte GZIP_HEADER[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+    memcpy(_output, GZIP_HEADER, sizeof(GZIP_HEADER));
+    _outputLength = sizeof(GZIP_HEADER);
+    _checksum = 0xffffffff;
+  } else {
+    // Compression method deflate with the window size, fastest compression level and the check bits
+    uint8_t windowBits = 0;
+    while ((1u << (windowBits + 1)) <= WINDOW_SIZE) {
+      windowBits++;
+    }
+    byte cmf = ((windowBits - 8) << 4) | 8;
+    putByte(cmf);
+    putByte(31 - (cmf * 256) % 31);
+    _checksum = 1;
+  }
+
+  // All data is sent in one block with the fixed Huffman codes, which is not the last one
+  putBits(0, 1);
+  putBits(1, 2);
+  return true;
+}
+
+/**
+ * Compresses data and returns the number of bytes that have been consumed. Less than length bytes
+ * are consumed if the output buffer is full.
+ */
+size_t DeflateEncoder::write(const byte * data, size_t length) {
+  size_t consumed = 0;
+  while (!_finished) {
+    compress(false);
+    if (consumed == length || isOutputFull()) {
+      break;
+    }
+    if (_end == 2 * WINDOW_SIZE) {
+      slideWindow();
+    }
+    size_t copyLength = std::min(length - consumed, 2 * WINDOW_SIZE - _end);
+    memcpy(_window + _end, data + consumed, copyLength);
+    updateChecksum(data + consumed, copyLength);
+    _end += copyLength;
+    _inputLength += copyLength;
+    consumed += copyLength;
+  }
+  return consumed;
+}
+
+/**
+ * Compresses the remaining data and ends the stream. If this returns false, the output buffer is
+ * full and finish() has to be called again after clearOutput().
+ */
+bool DeflateEncoder::finish() {
+  if (_finished) {
+    return true;
+  }
+  compress(true);
+  if (_pos < _end) {
+    return false;
+  }
+
+  // End of the block, followed by an empty final block, as the first one has not been marked as final
+  putSymbol(256);
+  putBits(1, 1);
+  putBits(1, 2);
+  putSymbol(256);
+  if (_bitCount > 0) {
+    putBits(0, 8 - _bitCount);
+  }
+
+  if (_format == FORMAT_GZIP) {
+    uint32_t crc = ~_checksum;
+    for (int i = 0; i < 4; i++) {
+      putByte((crc >> (8 * i)) & 0xff);
+    }
+    for (int i = 0; i < 4; i++) {
+      putByte((_inputLength >> (8 * i)) & 0xff);
+    }
+  } else {
+    for (int i = 3; i >= 0; i--) {
+      putByte((_checksum >> (8 * i)) & 0xff);
+    }
+  }
+  _finished = true;
+  return true;
+}
+
+const byte * DeflateEncoder::getOutput() {
+  return _output;
+}
+
+/**
+ * Returns the number of compressed bytes that are waiting in the output buffer
+ */
+size_t DeflateEncoder::getOutputLength() {
+  return _outputLength;
+}
+
+/**
+ * Returns true, if the output has to be cleared before more data can be compressed
+ */
+bool DeflateEncoder::isOutputFull() {
+  return _outputLength + OUTPUT_RESERVE > HTTPS_DEFLATE_OUTPUT_SIZE;
+}
+
+void DeflateEncoder::clearOutput() {
+  _outputLength = 0;
+}
+
+/**
+ * Encodes the data in the window as literals and matches. Unless flush is true, MAX_MATCH bytes
+ * are kept back, as they may become part of a longer match with the next data.
+ */
+void DeflateEncoder::compress(bool flush) {
+  while (_pos < _end && (flush || _end - _pos >= MAX_MATCH) && !isOutputFull()) {
+    size_t distance = 0;
+    size_t length = findMatch(&distance);
+    if (length >= MIN_MATCH) {
+      putMatch(length, distance);
+      for (size_t i = 0; i < length; i++) {
+        insertHash(_pos + i);
+      }
+      _pos += length;
+    } else {
+      putSymbol(_window[_pos]);
+      insertHash(_pos);
+      _pos++;
+    }
+  }
+}
+
+/**
+ * Returns the length of the longest match for the data at _pos and stores its distance
+ */
+size_t DeflateEncoder::findMatch(size_t * distance) {
+  if (_pos + MIN_MATCH > _end) {
+    return 0;
+  }
+  size_t maxLength = std::min(MAX_MATCH, _end - _pos);
+  const byte * current = _window + _pos;
+  size_t bestLength = 0;
+  uint16_t candidate = _head[hashBytes(current)];
+  for (size_t chain = 0; chain < MAX_CHAIN && candidate != 0; chain++) {
+    size_t candidatePos = candidate - 1;
+    if (candidatePos >= _pos || _pos - candidatePos >= WINDOW_SIZE) {
+      break;
+    }
+    const byte * match = _window + candidatePos;
+    // Only compare the whole match if it could be longer than the best one
+    if (match[bestLength] == current[bestLength]) {
+      size_t length = 0;
+      while (length < maxLength && match[length] == current[length]) {
+        length++;
+      }
+      if (length > bestLength) {
+        bestLength = length;
+        *distance = _pos - candidatePos;
+        if (length == maxLength) {
+          break;
+        }
+      }
+    }
+    // Positions in a chain are descending, anything else belongs to data that has been overwritten
+    uint16_t next = _prev[candidatePos & (WINDOW_SIZE - 1)];
+    if (next >= candidate) {
+      break;
+    }
+    candidate = next;
+  }
+  return bestLength;
+}
+
+void DeflateEncoder::insertHash(size_t pos) {
+  if (pos + MIN_MATCH > _end) {
+    return;
+  }
+  size_t hash = hashBytes(_window + pos);
+  _prev[pos & (WINDOW_SIZE - 1)] = _head[hash];
+  _head[hash] = pos + 1;
+}
+
+/**
+ * Moves the second half of the window to the first one, so that new data can be appended
+ */
+void DeflateEncoder::slideWindow() {
+  memcpy(_window, _window + WINDOW_SIZE, WINDOW_SIZE);
+  _pos -= WINDOW_SIZE;
+  _end -= WINDOW_SIZE;
+  for (size_t i = 0; i < HASH_SIZE; i++) {
+    _head[i] = (_head[i] > WINDOW_SIZE ? _head[i] - WINDOW_SIZE : 0);
+  }
+  for (size_t i = 0; i < WINDOW_SIZE; i++) {
+    _prev[i] = (_prev[i] > WINDOW_SIZE ? _prev[i] - WINDOW_SIZE : 0);
+  }
+}
+
+void DeflateEncoder::updateChecksum(const byte * data, size_t length) {
+  if (_format == FORMAT_GZIP) {
+    uint32_t crc = _checksum;
+    for (size_t i = 0; i < length; i++) {
+      crc ^= data[i];
+      crc = (crc >> 4) ^ CRC32_TABLE[crc & 0x0f];
+      crc = (crc >> 4) ^ CRC32_TABLE[crc & 0x0f];
+    }
+    _checksum = crc;
+  } else {
+    // Adler-32. The sums cannot overflow within 5552 bytes, so the modulo is only needed once per block
+    uint32_t s1 = _checksum & 0xffff;
+    uint32_t s2 = _checksum >> 16;
+    while (length > 0) {
+      size_t blockLength = std::min(length, (size_t)5552);
+      for (size_t i = 0; i < blockLength; i++) {
+        s1 += data[i];
+        s2 += s1;
+      }
+      s1 %= 65521;
+      s2 %= 65521;
+      data += blockLength;
+      length -= blockLength;
+    }
+    _checksum = (s2 << 16) | s1;
+  }
+}
+
+void DeflateEncoder::putByte(byte b) {
+  _output[_outputLength++] = b;
+}
+
+/**
+ * Appends up to 16 bits, starting with the least significant one
+ */
+void DeflateEncoder::putBits(uint32_t bits, uint8_t count) {
+  _bitBuffer |= bits << _bitCount;
+  _bitCount += count;
+  while (_bitCount >= 8) {
+    putByte(_bitBuffer & 0xff);
+    _bitBuffer >>= 8;
+    _bitCount -= 8;
+  }
+}
+
+/**
+ * Appends a Huffman code, which is packed starting with its most significant bit
+ */
+void DeflateEncoder::putHuffmanCode(uint16_t code, uint8_t length) {
+  uint16_t reversed = 0;
+  for (uint8_t i = 0; i < length; i++) {
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  putBits(reversed, length);
+}
+
+/**
+ * Appends a literal/length symbol with its fixed Huffman code (RFC 1951, 3.2.6)
+ */
+void DeflateEncoder::putSymbol(uint16_t symbol) {
+  if (symbol < 144) {
+    putHuffmanCode(0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    putHuffmanCode(0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    putHuffmanCode(symbol - 256, 7);
+  } else {
+    putHuffmanCode(0xc0 + symbol - 280, 8);
+  }
+}
+
+void DeflateEncoder::putMatch(size_t length, size_t distance) {
+  int lengthCode = 28;
+  while (LENGTH_BASE[lengthCode] > length) {
+    lengthCode--;
+  }
+  putSymbol(257 + lengthCode);
+  putBits(length - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+
+  int distanceCode = 29;
+  while (DISTANCE_BASE[distanceCode] > distance) {
+    distanceCode--;
+  }
+  putHuffmanCode(distanceCode, 5);
+  putBits(distance - DISTANCE_BASE[distanceCode], DISTANCE_EXTRA[distanceCode]);
+}
+
+} /* namespace httpsserver */
@@ -0,0 +1,84 @@
+#ifndef SRC_DEFLATEENCODER_HPP_
+#define SRC_DEFLATEENCODER_HPP_
+
+#include <Arduino.h>
+
+#include "HTTPSServerConstants.hpp"
+
+namespace httpsserver {
+
+/**
+ * \brief Streaming compressor for the gzip and deflate content codings
+ *
+ * Data is compressed with LZ77 in a window of HTTPS_DEFLATE_WINDOW_SIZE bytes and encoded with the
+ * fixed Huffman codes of deflate (RFC 1951). This trades some compression ratio for a small amount
+ * of memory and CPU time, which suits text like HTML or JSON.
+ *
+ * The compressed data is collected in an output buffer. write() consumes input until the buffer is
+ * full, so the caller has to send and clear the output whenever isOutputFull() returns true, and
+ * call finish() until it returns true at the end of the data.
+ *
+ * An encoder can be reused for several streams by calling begin() again. The memory for the window
+ * is allocated on the first call.
+ */
+class DeflateEncoder {
+public:
+  enum Format {
+    /** gzip file format (RFC 1952), for Content-Encoding: gzip */
+    FORMAT_GZIP,
+    /** zlib data format (RFC 1950), for Content-Encoding: deflate */
+    FORMAT_ZLIB
+  };
+
+  DeflateEncoder();
+  virtual ~DeflateEncoder();
+
+  bool begin(Format format);
+  size_t write(const byte * data, size_t length);
+  bool finish();
+
+  const byte * getOutput();
+  size_t getOutputLength();
+  bool isOutputFull();
+  void clearOutput();
+
+private:
+  void compress(bool flush);
+  size_t findMatch(size_t * distance);
+  void insertHash(size_t pos);
+  void slideWindow();
+  void updateChecksum(const byte * data, size_t length);
+
+  void putByte(byte b);
+  void putBits(uint32_t bits, uint8_t count);
+  void putHuffmanCode(uint16_t code, uint8_t length);
+  void putSymbol(uint16_t symbol);
+  void putMatch(size_t length, size_t distance);
+
+  Format _format;
+
+  // Data of the current and the previous window. Everything before _pos has been encoded
+  byte * _window;
+  size_t _pos;
+  size_t _end;
+
+  // Hash chains to find matches: _head contains the most recent position (+1) of each hash value,
+  // _prev the previous position with the same hash for each position in the window
+  uint16_t * _head;
+  uint16_t * _prev;
+
+  byte _output[HTTPS_DEFLATE_OUTPUT_SIZE];
+  size_t _outputLength;
+  // Bits that do not form a complete byte yet
+  uint32_t _bitBuffer;
+  uint8_t _bitCount;
+
+  // CRC-32 for gzip, Adler-32 for zlib
+  uint32_t _checksum;
+  uint32_t _inputLength;
+  bool _finished;
+};
+
+} /* namespace httpsserver */
+
+#endif /* SRC_DEFLATEENCODER_HPP_ */
@@ -12,17 +12,73 @@ HTTPConnection::HTTPConnection(ResourceResolver * resResolver):
 
   _connectionState = STATE_UNDEFINED;
   _clientState = CSTATE_UNDEFINED;
-  _httpHeaders = NULL;
+  _socketState = SOCKETSTATE_UNKNOWN;
+  _httpHeaders = new HTTPHeaders(&_requestArena);
   _defaultHeaders = NULL;
+  _defaultHeaderBlock = NULL;
+  _microCache = NULL;
+  _autoETag = false;
   _isKeepAlive = false;
+  _requestCount = 0;
   _lastTransmissionTS = millis();
   _shutdownTS = 0;
   _wsHandler = nullptr;
+  _sendQueueOffset = 0;
+  _sendQueueHighWaterMark = HTTPS_SEND_QUEUE_HIGH_WATER_MARK;
+  _responseBuffer = NULL;
+  _responseBufferSize = HTTPS_KEEPALIVE_CACHESIZE;
+  _deflateEncoder = NULL;
 }
 
 HTTPConnection::~HTTPConnection() {
-  // Close the socket
+  // Close the socket, there is no time left to send queued data
+  discardSendQueue();
   closeConnection();
+
+  delete _httpHeaders;
+  if (_responseBuffer != NULL) {
+    delete[] _responseBuffer;
+  }
+  if (_deflateEncoder != NULL) {
+    delete _deflateEncoder;
+  }
+}
+
+/**
+ * Prepares a closed connection for the next client, so that the object can be reused.
+ *
+ * Afterwards, the connection is in the same state as a newly created one.
+ */
+void HTTPConnection::reset() {
+  _socket = -1;
+  _addrLen = 0;
+
+  _bufferProcessed = 0;
+  _bufferUnusedIdx = 0;
+
+  _connectionState = STATE_UNDEFINED;
+  _clientState = CSTATE_UNDEFINED;
+  _socketState = SOCKETSTATE_UNKNOWN;
+  _httpHeaders->clearAll();
+  _requestArena.reset();
+  _defaultHeaders = NULL;
+  _defaultHeaderBlock = NULL;
+  _microCache = NULL;
+  _isKeepAlive = false;
+  _requestCount = 0;
+  _lastTransmissionTS = millis();
+  _shutdownTS = 0;
+
+  _parserLine.text.clear();
+  _parserLine.parsingFinished = false;
+  _parserLine.waitingForData = false;
+  _httpMethod.clear();
+  _httpResource.clear();
+  _httpVersion.clear();
+
+  // Release the memory of the queue, it might have grown large for a slow client
+  std::string().swap(_sendQueue);
+  _sendQueueOffset = 0;
 }
 
 /**
@@ -38,14 +94,22 @@ int HTTPConnection::initialize(int serverSocketID, HTTPHeaders *defaultHeaders)
 
     // Build up SSL Connection context if the socket has been created successfully
     if (_socket >= 0) {
-      HTTPS_LOGI("New connection. Socket FID=%d", _socket);
-      _connectionState = STATE_INITIAL;
-      _httpHeaders = new HTTPHeaders();
-      refreshTimeout();
-      return _socket;
+      // The socket is non-blocking, so that a slow client cannot block the server. Data that
+      // cannot be sent immediately is queued, see writeBuffer()
+      int flags = fcntl(_socket, F_GETFL, 0);
+      if (flags >= 0 && fcntl(_socket, F_SETFL, flags | O_NONBLOCK) >= 0) {
+        HTTPS_LOGI("New connection. Socket FID=%d", _socket);
+        _connectionState = STATE_INITIAL;
+        refreshTimeout();
+        return _socket;
+      }
+      HTTPS_LOGE("Could not make socket non-blocking. FID=%d", _socket);
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      // The server socket is non-blocking, there is no connection waiting
+      HTTPS_LOGD("No connection to accept()");
+    } else {
+      HTTPS_LOGE("Could not accept() new connection");
     }
-     
-    HTTPS_LOGE("Could not accept() new connection");
    
     _addrLen = 0;
     _connectionState = STATE_ERROR;
@@ -59,6 +123,13 @@ int HTTPConnection::initialize(int serverSocketID, HTTPHeaders *defaultHeaders)
   return -1;
 }
 
+/**
+ * Returns true, if the client can receive responses with Transfer-Encoding: chunked (HTTP/1.1)
+ */
+bool HTTPConnection::supportsChunkedEncoding() {
+  return _httpVersion == "HTTP/1.1";
+}
+
 /**
  * Returns the client's IPv4
  */
@@ -76,7 +147,7 @@ IPAddress HTTPConnection::getClientIP() {
  * (Should be checkd in the loop and transition should go to CONNECTION_CLOSE if exceeded)
  */
 bool HTTPConnection::isTimeoutExceeded() {
-  return _lastTransmissionTS + HTTPS_CONNECTION_TIMEOUT < millis();
+  return getRemainingTimeout() == 0;
 }
 
 /**
@@ -93,6 +164,13 @@ bool HTTPConnection::isClosed() {
   return (_connectionState == STATE_ERROR || _connectionState == STATE_CLOSED);
 }
 
+/**
+ * Returns true, if the connection is not in use and can be initialized for a new client
+ */
+bool HTTPConnection::isFree() {
+  return (_connectionState == STATE_UNDEFINED);
+}
+
 /**
  * Returns true, if the connection has been closed due to error
  */
@@ -104,6 +182,127 @@ bool HTTPConnection::isSecure() {
   return false;
 }
 
+/**
+ * Returns the socket of this connection, or -1 if there is no open socket
+ */
+int HTTPConnection::getSocket() {
+  return _socket;
+}
+
+/**
+ * Returns true, if loop() has to be called even if there is no new data on the socket.
+ *
+ * This is the case if there is unprocessed data in the receive buffer or in the TLS layer,
+ * if the state machine can advance without input or if the timeout has to be handled.
+ */
+bool HTTPConnection::hasPendingWork() {
+  switch(_connectionState) {
+  case STATE_HEADERS_FINISHED:
+  case STATE_BODY_FINISHED:
+    return true;
+  case STATE_CLOSING:
+    // Queued data is flushed when the socket becomes writable
+    return getSendQueueSize() == 0 || isTimeoutExceeded();
+  case STATE_HANDSHAKE:
+    // The handshake only advances if the socket is ready, except for its timeout
+    return isTimeoutExceeded();
+  case STATE_WEBSOCKET:
+    // The handler may have been closed from outside of the connection's loop
+    return _wsHandler->closed() || _bufferProcessed < _bufferUnusedIdx || pendingByteCount() > 0;
+  default:
+    break;
+  }
+  // A line that is not complete yet does not need processing before more data arrives
+  return (_bufferProcessed < _bufferUnusedIdx && !_parserLine.waitingForData) ||
+    _clientState == CSTATE_CLOSED ||
+    isTimeoutExceeded() ||
+    pendingByteCount() > 0;
+}
+
+/**
+ * Returns the time in milliseconds until the connection times out without further transmissions.
+ *
+ * Websockets do not time out, so the maximum value is returned for them.
+ */
+unsigned long HTTPConnection::getRemainingTimeout() {
+  if (_connectionState == STATE_WEBSOCKET) {
+    return ULONG_MAX;
+  }
+  if (_connectionState == STATE_CLOSING) {
+    unsigned long elapsed = millis() - _shutdownTS;
+    return (elapsed < HTTPS_SHUTDOWN_TIMEOUT) ? (HTTPS_SHUTDOWN_TIMEOUT - elapsed) : 0;
+  }
+  unsigned long timeout = HTTPS_CONNECTION_TIMEOUT;
+  if (_connectionState == STATE_HANDSHAKE) {
+    timeout = HTTPS_HANDSHAKE_TIMEOUT;
+  } else if (isIdle()) {
+    timeout = HTTPS_KEEPALIVE_TIMEOUT;
+  }
+  unsigned long elapsed = millis() - _lastTransmissionTS;
+  return (elapsed < timeout) ? (timeout - elapsed) : 0;
+}
+
+/**
+ * Used by the server to pass the result of its readiness poll for the socket of this connection
+ * to the next call of loop(), so that the connection does not need to check the socket again.
+ */
+void HTTPConnection::setSocketReadable(bool readable) {
+  _socketState = readable ? SOCKETSTATE_READABLE : SOCKETSTATE_NOT_READABLE;
+}
+
+/**
+ * Returns true, if this is a keep-alive connection that waits for the next request.
+ *
+ * Idle connections use HTTPS_KEEPALIVE_TIMEOUT and may be closed by the server if it needs the
+ * slot for a new client.
+ */
+bool HTTPConnection::isIdle() {
+  return _connectionState == STATE_INITIAL && _requestCount > 0 &&
+    getBufferedLength() == 0 && _parserLine.text.empty() && getSendQueueSize() == 0;
+}
+
+/**
+ * Returns the time in milliseconds since the last transmission on this connection
+ */
+unsigned long HTTPConnection::getIdleTime() {
+  return millis() - _lastTransmissionTS;
+}
+
+/**
+ * Returns true, if loop() has to be called as soon as the socket is writable, e.g. because there
+ * is queued data that has to be sent
+ */
+bool HTTPConnection::hasPendingOutput() {
+  return getSendQueueSize() > 0;
+}
+
+/**
+ * Sets the number of bytes that may be queued for sending before writes start to block
+ */
+void HTTPConnection::setSendQueueHighWaterMark(size_t highWaterMark) {
+  _sendQueueHighWaterMark = highWaterMark;
+}
+
+size_t HTTPConnection::getSendQueueHighWaterMark() {
+  return _sendQueueHighWaterMark;
+}
+
+/**
+ * Returns the number of bytes that have been written but could not be sent to the client yet
+ */
+size_t HTTPConnection::getSendQueueSize() {
+  return _sendQueue.length() - _sendQueueOffset;
+}
+
+/**
+ * Advances the handshake of the connection if it is in STATE_HANDSHAKE.
+ *
+ * Plain connections do not have a handshake, so they continue with the request directly.
+ */
+void HTTPConnection::continueHandshake() {
+  _connectionState = STATE_INITIAL;
+}
+
 void HTTPConnection::closeConnection() {
   // TODO: Call an event handler here, maybe?
 
@@ -119,6 +318,11 @@ void HTTPConnection::closeConnection() {
     _connectionState = STATE_CLOSING;
   }
 
+  // Everything that has been written should reach the client before the socket is closed
+  if (!isSendQueueDrained()) {
+    return;
+  }
+
   // Tear down the socket
   if (_socket >= 0) {
     HTTPS_LOGI("Connection closed. Socket FID=%d", _socket);
@@ -131,11 +335,8 @@ void HTTPConnection::closeConnection() {
     _connectionState = STATE_CLOSED;
   }
 
-  if (_httpHeaders != NULL) {
-    HTTPS_LOGD("Free headers");
-    delete _httpHeaders;
-    _httpHeaders = NULL;
-  }
+  // The headers object is kept for the next client
+  _httpHeaders->clearAll();
 
   if (_wsHandler != nullptr) {
     HTTPS_LOGD("Free WS Handler");
@@ -150,28 +351,26 @@ void HTTPConnection::closeConnection() {
 int HTTPConnection::updateBuffer() {
   if (!isClosed()) {
 
-    // If there is buffer data that has been marked as processed.
-    // Some example is shown here:
+    // If all data in the buffer has been processed, we can start at the beginning again for free
+    if (_bufferProcessed == _bufferUnusedIdx) {
+      _bufferProcessed = 0;
+      _bufferUnusedIdx = 0;
+    }
+
+    // Data that has been marked as processed is only removed if there is no space left at the end of
+    // the buffer. Some example is shown here:
     //
     // Previous configuration:
-    // GET / HTTP/1.1\\Host: test\\Foo: bar\\\\[some uninitialized memory]
-    //                 ^ processed             ^ unusedIdx
+    // GET / HTTP/1.1\\Host: test\\Foo: bar\\\\Content-Le
+    //                 ^ processed                   ^ unusedIdx (= end of buffer)
     //
     // New configuration after shifting:
-    // Host: test\\Foo: bar\\\\[some uninitialized memory]
-    // ^ processed             ^ unusedIdx
-    if (_bufferProcessed > 0) {
-      for(int i = 0; i < HTTPS_CONNECTION_DATA_CHUNK_SIZE; i++) {
-        int copyFrom = i + _bufferProcessed;
-        if (copyFrom < _bufferUnusedIdx) {
-          _receiveBuffer[i] = _receiveBuffer[copyFrom];
-        } else {
-          break;
-        }
-      }
+    // Host: test\\Foo: bar\\\\Content-Le[some uninitialized memory]
+    // ^ processed                   ^ unusedIdx
+    if (_bufferUnusedIdx == HTTPS_CONNECTION_DATA_CHUNK_SIZE && _bufferProcessed > 0) {
+      memmove(_receiveBuffer, _receiveBuffer + _bufferProcessed, _bufferUnusedIdx - _bufferProcessed);
       _bufferUnusedIdx -= _bufferProcessed;
       _bufferProcessed = 0;
-
     }
 
     if (_bufferUnusedIdx < HTTPS_CONNECTION_DATA_CHUNK_SIZE) {
@@ -194,6 +393,7 @@ int HTTPConnection::updateBuffer() {
 
         if (readReturnCode > 0) {
           _bufferUnusedIdx += readReturnCode;
+          _parserLine.waitingForData = false;
           refreshTimeout();
           return readReturnCode;
 
@@ -203,6 +403,9 @@ int HTTPConnection::updateBuffer() {
           HTTPS_LOGI("Client closed connection, FID=%d", _socket);
           // TODO: If we are in state websocket, we might need to do something here
           return 0;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          // The data is not complete yet (e.g. a partial TLS record), so there is nothing to read
+          return 0;
         } else {
           // An error occured
           _connectionState = STATE_ERROR;
@@ -219,6 +422,13 @@ int HTTPConnection::updateBuffer() {
 }
 
 bool HTTPConnection::canReadData() {
+  // If the server has polled the socket right before, we can use that result once
+  if (_socketState != SOCKETSTATE_UNKNOWN) {
+    bool readable = (_socketState == SOCKETSTATE_READABLE);
+    _socketState = SOCKETSTATE_UNKNOWN;
+    return readable;
+  }
+
   fd_set sockfds;
   FD_ZERO( &sockfds );
   FD_SET(_socket, &sockfds);
@@ -238,32 +448,244 @@ bool HTTPConnection::canReadData() {
 
 size_t HTTPConnection::readBuffer(byte* buffer, size_t length) {
   updateBuffer();
-  size_t bufferSize = _bufferUnusedIdx - _bufferProcessed;
+  size_t bufferSize = getBufferedLength();
 
   if (length > bufferSize) {
     length = bufferSize;
   }
 
-  // Write until length is reached (either by param of by empty buffer
-  for(int i = 0; i < length; i++) {
-    buffer[i] = _receiveBuffer[_bufferProcessed++];
-  }
+  // Copy until length is reached (either by param of by empty buffer)
+  memcpy(buffer, getBufferedData(), length);
+  consumeBuffer(length);
 
   return length;
 }
 
+/**
+ * Returns the start of the data in the receive buffer that has not been processed yet.
+ *
+ * The data is contiguous, getBufferedLength() bytes may be accessed.
+ */
+const char * HTTPConnection::getBufferedData() {
+  return _receiveBuffer + _bufferProcessed;
+}
+
+/**
+ * Returns the number of bytes in the receive buffer that have not been processed yet
+ */
+size_t HTTPConnection::getBufferedLength() {
+  return _bufferUnusedIdx - _bufferProcessed;
+}
+
+/**
+ * Marks the given number of bytes at the start of the buffered data as processed
+ */
+void HTTPConnection::consumeBuffer(size_t length) {
+  _bufferProcessed += length;
+}
+
 size_t HTTPConnection::pendingBufferSize() {
   updateBuffer();
 
-  return _bufferUnusedIdx - _bufferProcessed + pendingByteCount();
+  return getBufferedLength() + pendingByteCount();
+}
+
+/**
+ * Returns true, if no more request data can arrive: The connection is closing (e.g. after an error
+ * response) or has timed out, or the client has closed its side and everything it has sent has
+ * been read.
+ */
+bool HTTPConnection::isInputClosed() {
+  return isClosed() || _connectionState == STATE_CLOSING || isTimeoutExceeded() ||
+    (_clientState == CSTATE_CLOSED && getBufferedLength() == 0 && pendingByteCount() == 0);
 }
 
 size_t HTTPConnection::pendingByteCount() {
   return 0; // FIXME: Add the value of the equivalent function of SSL_pending() here
 }
 
+/**
+ * Writes data to the client without blocking.
+ *
+ * What cannot be sent immediately is added to the send queue of the connection, which is flushed
+ * whenever the socket becomes writable. Only if the queue exceeds its high-water mark, the call
+ * blocks until the client has received enough data.
+ */
 size_t HTTPConnection::writeBuffer(byte* buffer, size_t length) {
-  return send(_socket, buffer, length, 0);
+  return writeBuffers(buffer, length, NULL, 0);
+}
+
+/**
+ * Writes two buffers to the client, so that they can share a TCP segment. See writeBuffer().
+ */
+size_t HTTPConnection::writeBuffers(byte* head, size_t headLength, byte* body, size_t bodyLength) {
+  // Once the connection is closing (e.g. after an error response), nothing may be added anymore
+  if (_connectionState == STATE_CLOSING || !queueBuffers(head, headLength, body, bodyLength)) {
+    return -1;
+  }
+
+  // Backpressure: If the client does not receive fast enough, we have to wait for it
+  if (!waitForSendQueue(_sendQueueHighWaterMark)) {
+    return -1;
+  }
+  return headLength + bodyLength;
+}
+
+/**
+ * Sends as much of the two buffers as the socket accepts without blocking and adds the rest to the
+ * send queue.
+ *
+ * Returns false if an error occured.
+ */
+bool HTTPConnection::queueBuffers(byte* head, size_t headLength, byte* body, size_t bodyLength) {
+  if (_socket < 0) {
+    return false;
+  }
+
+  // Previously queued data has to be sent first
+  if (getSendQueueSize() > 0 && !flushSendQueue()) {
+    return false;
+  }
+
+  size_t written = 0;
+  if (getSendQueueSize() == 0) {
+    int res = sendBytes(head, headLength, body, bodyLength);
+    if (res < 0) {
+      handleSendError();
+      return false;
+    }
+    written = res;
+  }
+
+  // Queue everything that could not be sent
+  if (written < headLength) {
+    _sendQueue.append((char*)head + written, headLength - written);
+  }
+  size_t bodyOffset = (written > headLength) ? written - headLength : 0;
+  if (bodyOffset < bodyLength) {
+    _sendQueue.append((char*)body + bodyOffset, bodyLength - bodyOffset);
+  }
+  return true;
+}
+
+/**
+ * Sends data to the socket without blocking.
+ *
+ * Returns the number of bytes that have been sent, which may be 0 if the socket is not ready. If an
+ * error occurs, -1 is returned.
+ */
+int HTTPConnection::sendBytes(byte* head, size_t headLength, byte* body, size_t bodyLength) {
+  // Both buffers are written with a single gather write
+  struct iovec iov[2];
+  iov[0].iov_base = head;
+  iov[0].iov_len = headLength;
+  iov[1].iov_base = body;
+  iov[1].iov_len = bodyLength;
+  int res = writev(_socket, iov, bodyLength > 0 ? 2 : 1);
+  if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return 0;
+  }
+  return res;
+}
+
+/**
+ * Sends as much of the send queue as the socket accepts without blocking.
+ *
+ * Returns false if an error occured.
+ */
+bool HTTPConnection::flushSendQueue() {
+  while (getSendQueueSize() > 0) {
+    int res = sendBytes((byte*)_sendQueue.data() + _sendQueueOffset, getSendQueueSize(), NULL, 0);
+    if (res < 0) {
+      handleSendError();
+      return false;
+    }
+    if (res == 0) {
+      break;
+    }
+    _sendQueueOffset += res;
+    refreshTimeout();
+  }
+
+  // Remove the data that has been sent. Shifting is only done if it frees a reasonable amount of memory
+  if (getSendQueueSize() == 0) {
+    _sendQueue.clear();
+    _sendQueueOffset = 0;
+  } else if (_sendQueueOffset > _sendQueue.length() / 2) {
+    _sendQueue.erase(0, _sendQueueOffset);
+    _sendQueueOffset = 0;
+  }
+  return true;
+}
+
+/**
+ * Blocks until at most limit bytes are left in the send queue.
+ *
+ * Returns false if the data could not be sent because of an error or a timeout.
+ */
+bool HTTPConnection::waitForSendQueue(size_t limit) {
+  while (getSendQueueSize() > limit) {
+    if (!flushSendQueue()) {
+      return false;
+    }
+    if (getSendQueueSize() <= limit) {
+      break;
+    }
+
+    fd_set sockfds;
+    FD_ZERO(&sockfds);
+    FD_SET(_socket, &sockfds);
+
+    timeval timeout;
+    timeout.tv_sec  = HTTPS_CONNECTION_TIMEOUT / 1000;
+    timeout.tv_usec = (HTTPS_CONNECTION_TIMEOUT % 1000) * 1000;
+
+    if (select(_socket + 1, NULL, &sockfds, NULL, &timeout) == 0) {
+      HTTPS_LOGW("Timeout while waiting for the client to receive data. FID=%d", _socket);
+      handleSendError();
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Called if data cannot be sent to the client. The queued data is dropped and the connection
+ * will be closed.
+ */
+void HTTPConnection::handleSendError() {
+  HTTPS_LOGE("Could not send data to the client. FID=%d", _socket);
+  discardSendQueue();
+  _clientState = CSTATE_CLOSED;
+}
+
+/**
+ * Drops all data that has not been sent yet
+ */
+void HTTPConnection::discardSendQueue() {
+  _sendQueue.clear();
+  _sendQueueOffset = 0;
+}
+
+/**
+ * Used while the connection is closing. Tries to send the remaining data of the send queue.
+ *
+ * Returns true if the socket may be closed, which is the case if the queue is empty, if an error
+ * occured or if the shutdown timeout has been hit.
+ */
+bool HTTPConnection::isSendQueueDrained() {
+  if (getSendQueueSize() > 0 && _connectionState != STATE_ERROR && _socket >= 0) {
+    flushSendQueue();
+  }
+  if (getSendQueueSize() == 0) {
+    return true;
+  }
+  if (_connectionState == STATE_ERROR || _socket < 0 || millis() - _shutdownTS > HTTPS_SHUTDOWN_TIMEOUT) {
+    HTTPS_LOGW("Dropping %d bytes that could not be sent. FID=%d", getSendQueueSize(), _socket);
+    discardSendQueue();
+    return true;
+  }
+  return false;
 }
 
 size_t HTTPConnection::readBytesToBuffer(byte* buffer, size_t length) {
@@ -271,51 +693,96 @@ size_t HTTPConnection::readBytesToBuffer(byte* buffer, size_t length) {
 }
 
 void HTTPConnection::raiseError(uint16_t code, std::string reason) {
-  _connectionState = STATE_ERROR;
   std::string sCode = intToString(code);
 
-  char headers[] = "\r\nConnection: close\r\nContent-Type: text/plain;charset=utf8\r\n\r\n";
-  writeBuffer((byte*)"HTTP/1.1 ", 9);
-  writeBuffer((byte*)sCode.c_str(), sCode.length());
-  writeBuffer((byte*)" ", 1);
-  writeBuffer((byte*)(reason.c_str()), reason.length());
-  writeBuffer((byte*)headers, strlen(headers));
-  writeBuffer((byte*)sCode.c_str(), sCode.length());
-  writeBuffer((byte*)" ", 1);
-  writeBuffer((byte*)(reason.c_str()), reason.length());
+  // The error response is sent with a single write. What the client does not receive right away is
+  // sent by closeConnection() in STATE_CLOSING, so the server does not wait for a slow client here
+  std::string response = "HTTP/1.1 " + sCode + " " + reason +
+    "\r\nConnection: close\r\nContent-Type: text/plain;charset=utf8\r\n\r\n" +
+    sCode + " " + reason;
+  if (_connectionState != STATE_CLOSING && !queueBuffers((byte*)response.data(), response.length(), NULL, 0)) {
+    _connectionState = STATE_ERROR;
+  }
   closeConnection();
 }
 
-void HTTPConnection::readLine(int lengthLimit) {
-  while(_bufferProcessed < _bufferUnusedIdx) {
-    char newChar = _receiveBuffer[_bufferProcessed];
+/**
+ * Looks for the next line (terminated by \r\n) in the receive buffer.
+ *
+ * Returns true if a complete line is available. line and lineLength are then set to its content
+ * (without the \r\n). The line is consumed from the buffer, but the data stays accessible until
+ * the next call to updateBuffer(), so it can be used without copying it.
+ *
+ * Lines that do not fit into the receive buffer (only if lengthLimit is configured to be larger
+ * than the buffer) are collected in _parserLine.text.
+ */
+bool HTTPConnection::readLine(size_t lengthLimit, const char ** line, size_t * lineLength) {
+  // Drop the previous line, if it was collected outside of the buffer
+  if (_parserLine.parsingFinished) {
+    _parserLine.text.clear();
+    _parserLine.parsingFinished = false;
+  }
+
+  const char * data = getBufferedData();
+  size_t length = getBufferedLength();
+  const char * newline = (const char *)memchr(data, '\n', length);
 
-    if ( newChar == '\r') {
-      // Look ahead for \n (if not possible, wait for next round
-      if (_bufferProcessed+1 < _bufferUnusedIdx) {
-        if (_receiveBuffer[_bufferProcessed+1] == '\n') {
-          _bufferProcessed += 2;
-          _parserLine.parsingFinished = true;
-          return;
-        } else {
-          // Line has not been terminated by \r\n
-          HTTPS_LOGW("Line without \\r\\n (got only \\r). FID=%d", _socket);
-          raiseError(400, "Bad Request");
-          return;
-        }
-      }
-    } else {
-      _parserLine.text += newChar;
-      _bufferProcessed += 1;
-    }
+  if (newline == NULL) {
+    // A trailing \r may be the start of the line terminator, so it does not count as content
+    size_t contentLength = (length > 0 && data[length - 1] == '\r') ? length - 1 : length;
 
-    // Check that the max request string size is not exceeded
-    if (_parserLine.text.length() > lengthLimit) {
+    // Check that the max line length is not exceeded
+    if (_parserLine.text.length() + contentLength > lengthLimit) {
       HTTPS_LOGW("Header length exceeded. FID=%d", _socket);
       raiseError(431, "Request Header Fields Too Large");
-      return;
+      return false;
+    }
+
+    // If the buffer is full, move the line out of it to make space for the rest
+    if (length == HTTPS_CONNECTION_DATA_CHUNK_SIZE) {
+      _parserLine.text.append(data, contentLength);
+      consumeBuffer(contentLength);
     }
+
+    // Wait for the next round
+    _parserLine.waitingForData = true;
+    return false;
+  }
+  _parserLine.waitingForData = false;
+
+  // The line has to be terminated by \r\n, and there may be no other \r in it
+  size_t contentLength = newline - data;
+  if (contentLength == 0 || data[contentLength - 1] != '\r') {
+    HTTPS_LOGW("Line without \\r\\n (got only \\n). FID=%d", _socket);
+    raiseError(400, "Bad Request");
+    return false;
+  }
+  contentLength -= 1;
+  if (memchr(data, '\r', contentLength) != NULL) {
+    HTTPS_LOGW("Line without \\r\\n (got only \\r). FID=%d", _socket);
+    raiseError(400, "Bad Request");
+    return false;
   }
+
+  // Check that the max line length is not exceeded
+  if (_parserLine.text.length() + contentLength > lengthLimit) {
+    HTTPS_LOGW("Header length exceeded. FID=%d", _socket);
+    raiseError(431, "Request Header Fields Too Large");
+    return false;
+  }
+
+  if (_parserLine.text.empty()) {
+    // Usual case: The line is completely in the buffer
+    *line = data;
+    *lineLength = contentLength;
+  } else {
+    _parserLine.text.append(data, contentLength);
+    *line = _parserLine.text.data();
+    *lineLength = _parserLine.text.length();
+  }
+  _parserLine.parsingFinished = true;
+  consumeBuffer(contentLength + 2);
+  return true;
 }
 
 /**
@@ -333,103 +800,241 @@ void HTTPConnection::signalRequestError() {
   raiseError(400, "Bad Request");
 }
 
+/**
+ * Returns the arena that holds the objects of the current request
+ */
+RequestArena * HTTPConnection::getRequestArena() {
+  return &_requestArena;
+}
+
+/**
+ * Sets the serialized form of the default headers that have been passed to initialize()
+ */
+void HTTPConnection::setDefaultHeaderBlock(const std::string * block) {
+  _defaultHeaderBlock = block;
+}
+
+/**
+ * Sets the server's cache for responses of nodes that use ResourceNode::setMicroCacheTTL()
+ */
+void HTTPConnection::setMicroCache(MicroCache * microCache) {
+  _microCache = microCache;
+}
+
+/**
+ * Sets whether responses get an ETag from their buffered body by default (see HTTPResponse::setAutoETag())
+ */
+void HTTPConnection::setAutoETag(bool autoETag) {
+  _autoETag = autoETag;
+}
+
+/**
+ * Sets the size of the buffer that is used to determine the Content-Length of keep-alive responses.
+ * A size of 0 disables buffering. Must not be called while a request is processed.
+ */
+void HTTPConnection::setResponseBufferSize(size_t size) {
+  if (size != _responseBufferSize) {
+    if (_responseBuffer != NULL) {
+      delete[] _responseBuffer;
+      _responseBuffer = NULL;
+    }
+    _responseBufferSize = size;
+  }
+}
+
+/**
+ * Returns true, if the connection should be kept open after the current request
+ */
+bool HTTPConnection::isKeepAlive() {
+  return _isKeepAlive;
+}
+
 /**
  * Returns the cache size that should be cached (in the response) to enable keep-alive requests.
  *
  * 0 = no keep alive.
  */
 size_t HTTPConnection::getCacheSize() {
-  return (_isKeepAlive ? HTTPS_KEEPALIVE_CACHESIZE : 0);
+  return (_isKeepAlive ? _responseBufferSize : 0);
 }
 
-void HTTPConnection::loop() {
-  // First, update the buffer
-  // newByteCount will contain the number of new bytes that have to be processed
-  updateBuffer();
+/**
+ * Returns the response buffer of this connection, which has a size of getCacheSize()
+ */
+byte * HTTPConnection::getResponseBuffer() {
+  if (_responseBuffer == NULL && _responseBufferSize > 0) {
+    _responseBuffer = new byte[_responseBufferSize];
+  }
+  return _responseBuffer;
+}
 
-  if (_clientState == CSTATE_CLOSED) {
-    HTTPS_LOGI("Client closed (FID=%d, cstate=%d)", _socket, _clientState);
+/**
+ * Returns the encoder that compresses responses of this connection
+ */
+DeflateEncoder * HTTPConnection::getDeflateEncoder() {
+  if (_deflateEncoder == NULL) {
+    _deflateEncoder = new DeflateEncoder();
   }
+  return _deflateEncoder;
+}
 
-  if (_clientState == CSTATE_CLOSED && _bufferProcessed == _bufferUnusedIdx && _connectionState < STATE_HEADERS_FINISHED) {
-    closeConnection();
+void HTTPConnection::loop() {
+  // Continue sending data that has been queued before
+  if (getSendQueueSize() > 0 && _connectionState != STATE_CLOSING) {
+    flushSendQueue();
   }
 
-  if (!isClosed() && isTimeoutExceeded()) {
-    HTTPS_LOGI("Connection timeout. FID=%d", _socket);
-    closeConnection();
+  // Nothing may be read from the connection before the handshake is done
+  if (_connectionState == STATE_HANDSHAKE) {
+    if (isTimeoutExceeded()) {
+      HTTPS_LOGI("Handshake timeout. FID=%d", _socket);
+      _connectionState = STATE_ERROR;
+      closeConnection();
+    } else {
+      continueHandshake();
+    }
+    _socketState = SOCKETSTATE_UNKNOWN;
+    // If the handshake is done, the request may follow right away
+    if (_connectionState != STATE_INITIAL) {
+      return;
+    }
+  }
+
+  // The state machine keeps advancing while it makes progress, so that a request that has been
+  // received completely is answered in a single call. The number of steps is limited to give
+  // the other connections their turn.
+  for (int step = 0; step < HTTPS_CONNECTION_WORK_BUDGET; step++) {
+    int previousState = _connectionState;
+    int previousProcessed = _bufferProcessed;
+    int previousUnusedIdx = _bufferUnusedIdx;
+
+    // First, update the buffer
+    // newByteCount will contain the number of new bytes that have to be processed
+    updateBuffer();
+    // The readiness information of the server is outdated now (if it has not been used at all)
+    _socketState = SOCKETSTATE_UNKNOWN;
+
+    if (_clientState == CSTATE_CLOSED) {
+      HTTPS_LOGI("Client closed (FID=%d, cstate=%d)", _socket, _clientState);
+    }
+
+    if (_clientState == CSTATE_CLOSED && (_bufferProcessed == _bufferUnusedIdx || _parserLine.waitingForData) &&
+        _connectionState < STATE_HEADERS_FINISHED) {
+      closeConnection();
+    }
+
+    // Websockets do not time out (see STATE_WEBSOCKET below)
+    if (!isClosed() && _connectionState != STATE_WEBSOCKET && isTimeoutExceeded()) {
+      HTTPS_LOGI("Connection timeout. FID=%d", _socket);
+      closeConnection();
+    }
+
+    advanceState();
+
+    // Nothing has changed, so we need to wait for the client
+    if (isClosed() || (_connectionState == previousState &&
+        _bufferProcessed == previousProcessed && _bufferUnusedIdx == previousUnusedIdx)) {
+      break;
+    }
   }
+}
 
+/**
+ * Performs a single step of the state machine of the connection
+ */
+void HTTPConnection::advanceState() {
   if (!isError()) {
     // State machine (Reading request, reading headers, ...)
     switch(_connectionState) {
     case STATE_INITIAL: // Read request line
-      readLine(HTTPS_REQUEST_MAX_REQUEST_LENGTH);
-      if (_parserLine.parsingFinished && !isClosed()) {
-        // Find the method
-        size_t spaceAfterMethodIdx = _parserLine.text.find(' ');
-        if (spaceAfterMethodIdx == std::string::npos) {
-          HTTPS_LOGW("Missing space after method");
-          raiseError(400, "Bad Request");
-          break;
-        }
-        _httpMethod = _parserLine.text.substr(0, spaceAfterMethodIdx);
+      {
+        const char * line;
+        size_t lineLength;
+        if (readLine(HTTPS_REQUEST_MAX_REQUEST_LENGTH, &line, &lineLength)) {
+          const char * lineEnd = line + lineLength;
+
+          // Find the method
+          const char * spaceAfterMethod = (const char *)memchr(line, ' ', lineLength);
+          if (spaceAfterMethod == NULL) {
+            HTTPS_LOGW("Missing space after method");
+            raiseError(400, "Bad Request");
+            break;
+          }
+          _httpMethod.assign(line, spaceAfterMethod - line);
+
+          // Find the resource string:
+          const char * resource = spaceAfterMethod + 1;
+          const char * spaceAfterResource = (const char *)memchr(resource, ' ', lineEnd - resource);
+          if (spaceAfterResource == NULL) {
+            HTTPS_LOGW("Missing space after resource");
+            raiseError(400, "Bad Request");
+            break;
+          }
+          _httpResource.assign(resource, spaceAfterResource - resource);
 
-        // Find the resource string:
-        size_t spaceAfterResourceIdx = _parserLine.text.find(' ', spaceAfterMethodIdx + 1);
-        if (spaceAfterResourceIdx == std::string::npos) {
-          HTTPS_LOGW("Missing space after resource");
-          raiseError(400, "Bad Request");
-          break;
-        }
-        _httpResource = _parserLine.text.substr(spaceAfterMethodIdx + 1, spaceAfterResourceIdx - _httpMethod.length() - 1);
+          // The remainder is the protocol version
+          _httpVersion.assign(spaceAfterResource + 1, lineEnd - spaceAfterResource - 1);
 
-        _parserLine.parsingFinished = false;
-        _parserLine.text = "";
-        HTTPS_LOGI("Request: %s %s (FID=%d)", _httpMethod.c_str(), _httpResource.c_str(), _socket);
-        _connectionState = STATE_REQUEST_FINISHED;
+          HTTPS_LOGI("Request: %s %s (FID=%d)", _httpMethod.c_str(), _httpResource.c_str(), _socket);
+          _connectionState = STATE_REQUEST_FINISHED;
+        }
       }
 
-      break;
+      // If the headers have already been received (e.g. for pipelined requests), go on right away
+      if (_connectionState != STATE_REQUEST_FINISHED) {
+        break;
+      }
+      // fall through
     case STATE_REQUEST_FINISHED: // Read headers
-
-      while (_bufferProcessed < _bufferUnusedIdx && !isClosed()) {
-        readLine(HTTPS_REQUEST_MAX_HEADER_LENGTH);
-        if (_parserLine.parsingFinished && _connectionState != STATE_ERROR) {
-
-          if (_parserLine.text.empty()) {
+      {
+        const char * line;
+        size_t lineLength;
+        // Stop after the empty line, so that the body does not get flushed through
+        while (_connectionState == STATE_REQUEST_FINISHED && readLine(HTTPS_REQUEST_MAX_HEADER_LENGTH, &line, &lineLength)) {
+          if (lineLength == 0) {
             HTTPS_LOGD("Headers finished, FID=%d", _socket);
             _connectionState = STATE_HEADERS_FINISHED;
-
-            // Break, so that the rest of the body does not get flushed through
-            _parserLine.parsingFinished = false;
-            _parserLine.text = "";
-            break;
           } else {
-            int idxColon = _parserLine.text.find(':');
-            if ( (idxColon != std::string::npos) && (_parserLine.text[idxColon+1]==' ') ) {
-              _httpHeaders->set(new HTTPHeader(
-                  _parserLine.text.substr(0, idxColon),
-                  _parserLine.text.substr(idxColon+2)
-              ));
-              HTTPS_LOGD("Header: %s = %s (FID=%d)", _parserLine.text.substr(0, idxColon).c_str(), _parserLine.text.substr(idxColon+2).c_str(), _socket);
+            const char * colon = (const char *)memchr(line, ':', lineLength);
+            if (colon != NULL && colon != line) {
+              // Strip optional whitespace around the value
+              const char * value = colon + 1;
+              const char * valueEnd = line + lineLength;
+              while (value < valueEnd && (*value == ' ' || *value == '\t')) value++;
+              while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) valueEnd--;
+
+              _httpHeaders->set(
+                  std::string(line, colon - line),
+                  std::string(value, valueEnd - value)
+              );
+              HTTPS_LOGD("Header: %.*s = %.*s (FID=%d)", (int)(colon - line), line, (int)(valueEnd - value), value, _socket);
             } else {
-              HTTPS_LOGW("Malformed request header: %s", _parserLine.text.c_str());
+              HTTPS_LOGW("Malformed request header: %.*s", (int)lineLength, line);
               raiseError(400, "Bad Request");
-              break;
             }
           }
-
-          _parserLine.parsingFinished = false;
-          _parserLine.text = "";
         }
       }
 
-      break;
+      // The request is complete, so it can be handled right away
+      if (_connectionState != STATE_HEADERS_FINISHED) {
+        break;
+      }
+      // fall through
     case STATE_HEADERS_FINISHED: // Handle body
       {
+        // Without a supported transfer coding, the end of the body cannot be determined
+        uint16_t transferEncodingError = checkTransferEncoding();
+        if (transferEncodingError == 501) {
+          raiseError(501, "Not Implemented");
+          break;
+        } else if (transferEncodingError != 0) {
+          raiseError(400, "Bad Request");
+          break;
+        }
+
         HTTPS_LOGD("Resolving resource...");
-        ResolvedResource resolvedResource;
+        ResolvedResource resolvedResource(&_requestArena);
 
         // Check which kind of node we need (Websocket or regular)
         bool websocketRequested = checkWebsocket();
@@ -437,22 +1042,13 @@ void HTTPConnection::loop() {
         _resResolver->resolveNode(_httpMethod, _httpResource, resolvedResource, websocketRequested ? WEBSOCKET : HANDLER_CALLBACK);
 
         // Is there any match (may be the defaultNode, if it is configured)
-        if (resolvedResource.didMatch()) {
+        if (resolvedResource.didMatch() && sendCachedResponse(resolvedResource.getMatchingNode())) {
+          // Responses of caching nodes are sent without calling the middleware and the handler
+          HTTPS_LOGD("Response sent from micro cache. FID=%d", _socket);
+        } else if (resolvedResource.didMatch()) {
           // Check for client's request to keep-alive if we have a handler function.
           if (resolvedResource.getMatchingNode()->_nodeType == HANDLER_CALLBACK) {
-            // Did the client set connection:keep-alive?
-            HTTPHeader * connectionHeader = _httpHeaders->get("Connection");
-            std::string connectionHeaderValue = "";
-            if (connectionHeader != NULL) {
-              connectionHeaderValue += connectionHeader->_value;
-              std::transform(
-                connectionHeaderValue.begin(),
-                connectionHeaderValue.end(),
-                connectionHeaderValue.begin(),
-                [](unsigned char c){ return ::tolower(c); }
-              );
-            }
-            if (std::string("keep-alive").compare(connectionHeaderValue)==0) {
+            if (isKeepAliveRequested()) {
               HTTPS_LOGD("Keep-Alive activated. FID=%d", _socket);
               _isKeepAlive = true;
             } else {
@@ -463,6 +1059,13 @@ void HTTPConnection::loop() {
             _isKeepAlive = false;
           }
 
+          // Limit the number of requests per connection, so that other clients get their turn
+          _requestCount++;
+          if (_isKeepAlive && _requestCount >= HTTPS_KEEPALIVE_MAX_REQUESTS) {
+            HTTPS_LOGD("Keep-Alive request limit reached. FID=%d", _socket);
+            _isKeepAlive = false;
+          }
+
           // Create request context
           HTTPRequest req  = HTTPRequest(
             this,
@@ -474,10 +1077,15 @@ void HTTPConnection::loop() {
           );
           HTTPResponse res = HTTPResponse(this);
 
-          // Add default headers to the response
-          auto allDefaultHeaders = _defaultHeaders->getAll();
-          for(std::vector<HTTPHeader*>::iterator header = allDefaultHeaders->begin(); header != allDefaultHeaders->end(); ++header) {
-            res.setHeader((*header)->_name, (*header)->_value);
+          // Default headers are added when the response header is sent
+          res.setDefaultHeaders(_defaultHeaders, _defaultHeaderBlock);
+          // Conditional requests are evaluated by the response
+          res.setRequestHeaders(_httpHeaders);
+          res.setAutoETag(_autoETag);
+          // Complete responses of caching nodes are stored for the following requests
+          uint32_t microCacheTTL = getMicroCacheTTL(resolvedResource.getMatchingNode());
+          if (microCacheTTL > 0) {
+            res.setMicroCache(_microCache, getMicroCacheKey(), microCacheTTL);
           }
 
           // Find the request handler callback
@@ -530,8 +1138,7 @@ void HTTPConnection::loop() {
             // However, if the client did not set content-size or defined connection: close,
             // we have no chance to do so.
             // Also, the programmer may have explicitly set Connection: close for the response.
-            std::string hConnection = res.getHeader("Connection");
-            if (hConnection == "close") {
+            if (headerHasToken(res.getHeader(HEADER_CONNECTION), "close")) {
               _isKeepAlive = false;
             }
             if (!_isKeepAlive) {
@@ -541,11 +1148,16 @@ void HTTPConnection::loop() {
                 _connectionState = STATE_BODY_FINISHED;
               }
             } else {
-              if (res.isResponseBuffered()) {
-                // If the response could be buffered:
-                res.setHeader("Connection", "keep-alive");
-                res.finalize();
-                if (_clientState != CSTATE_CLOSED) {
+              if (res.isResponseLengthKnown() || !res.isHeaderWritten()) {
+                // If the response could be buffered or its length is defined otherwise:
+                res.setHeader(HEADER_CONNECTION, "keep-alive");
+              }
+              // A response that is streamed without a length switches to Connection: close
+              res.finalize();
+              if (!headerHasToken(res.getHeader(HEADER_CONNECTION), "close")) {
+                // If the client has closed its side after sending pipelined requests, they will
+                // still be answered
+                if (!isClosed() && (_clientState != CSTATE_CLOSED || getBufferedLength() > 0)) {
                   // Refresh the timeout for the new request
                   refreshTimeout();
                   // Reset headers for the new connection
@@ -554,7 +1166,7 @@ void HTTPConnection::loop() {
                   _connectionState = STATE_INITIAL;
                 }
               }
-              // The response could not be buffered or the client has closed:
+              // The response had to close the connection or the client has closed:
               if (!isClosed() && _connectionState!=STATE_INITIAL) {
                 _connectionState = STATE_BODY_FINISHED;
               }
@@ -567,6 +1179,10 @@ void HTTPConnection::loop() {
         }
 
       }
+      // The objects of the request have been destroyed, so the arena can be used for the next one
+      if (_connectionState == STATE_INITIAL) {
+        _requestArena.reset();
+      }
       break;
     case STATE_BODY_FINISHED: // Request is complete
       closeConnection();
@@ -602,13 +1218,140 @@ void HTTPConnection::loop() {
 }
 
 
+/**
+ * Returns true, if the client wants to reuse the connection for further requests.
+ *
+ * HTTP/1.1 connections are persistent unless the client sends Connection: close,
+ * HTTP/1.0 clients have to ask for keep-alive explicitly (RFC 7230, 6.3)
+ */
+bool HTTPConnection::isKeepAliveRequested() {
+  std::string connectionHeaderValue = _httpHeaders->getValue(HEADER_CONNECTION);
+  if (_httpHeaders->get(HEADER_TRANSFER_ENCODING) != NULL && _httpHeaders->get(HEADER_CONTENT_LENGTH) != NULL) {
+    // The message may be delimited differently by other recipients, so the connection must not
+    // be reused (RFC 7230, 3.3.3)
+    return false;
+  } else if (headerHasToken(connectionHeaderValue, "close")) {
+    return false;
+  } else if (_httpVersion == "HTTP/1.1") {
+    return true;
+  } else {
+    return headerHasToken(connectionHeaderValue, "keep-alive");
+  }
+}
+
+/**
+ * Checks the Transfer-Encoding of the request. The only supported transfer coding is chunked on
+ * its own (RFC 7230, 3.3.3).
+ *
+ * Returns 0 if the body can be read, 400 if chunked is not the final coding, so that the length of
+ * the body is unknown, or 501 for other codings in front of chunked.
+ */
+uint16_t HTTPConnection::checkTransferEncoding() {
+  HTTPHeader * transferEncoding = _httpHeaders->get(HEADER_TRANSFER_ENCODING);
+  if (transferEncoding == NULL) {
+    return 0;
+  }
+  std::string const &value = transferEncoding->_value;
+  size_t codingCount = 0;
+  bool lastIsChunked = false;
+  size_t start = 0;
+  while (start <= value.length()) {
+    size_t end = value.find(',', start);
+    if (end == std::string::npos) {
+      end = value.length();
+    }
+    // Strip optional whitespace around the element, empty elements are allowed in lists
+    size_t first = start;
+    size_t last = end;
+    while (first < last && (value[first] == ' ' || value[first] == '\t')) first++;
+    while (last > first && (value[last - 1] == ' ' || value[last - 1] == '\t')) last--;
+    if (last > first) {
+      codingCount++;
+      lastIsChunked = (last - first == 7 && strncasecmp(value.c_str() + first, "chunked", 7) == 0);
+    }
+    start = end + 1;
+  }
+  if (!lastIsChunked) {
+    HTTPS_LOGW("Transfer-Encoding does not end with chunked: %s", value.c_str());
+    return 400;
+  } else if (codingCount > 1) {
+    HTTPS_LOGW("Unsupported Transfer-Encoding: %s", value.c_str());
+    return 501;
+  }
+  return 0;
+}
+
+/**
+ * Returns the time (ms) for which the response to the current request may be cached, or 0 if the
+ * node does not use the micro cache or the request cannot be answered from it
+ */
+uint32_t HTTPConnection::getMicroCacheTTL(HTTPNode * node) {
+  if (_microCache == NULL || node->_nodeType != HANDLER_CALLBACK || _httpMethod != "GET" ||
+      _httpHeaders->get(HEADER_CONTENT_LENGTH) != NULL || _httpHeaders->get(HEADER_TRANSFER_ENCODING) != NULL) {
+    return 0;
+  }
+  return ((ResourceNode*)node)->getMicroCacheTTL();
+}
+
+/**
+ * Returns the key of the current request in the micro cache
+ */
+std::string HTTPConnection::getMicroCacheKey() {
+  return _httpMethod + " " + _httpResource;
+}
+
+/**
+ * Sends the response to the current request from the micro cache, if the node uses it and the
+ * response has been stored before. Returns false if the request has to be handled by the node.
+ *
+ * If the client already has the response (as indicated by If-None-Match), 304 Not Modified is sent
+ * with the stored headers instead.
+ */
+bool HTTPConnection::sendCachedResponse(HTTPNode * node) {
+  if (getMicroCacheTTL(node) == 0) {
+    return false;
+  }
+  std::shared_ptr<const MicroCache::Entry> entry;
+  if (!_microCache->get(getMicroCacheKey(), entry)) {
+    return false;
+  }
+
+  // Same as for handled requests, see STATE_HEADERS_FINISHED
+  _isKeepAlive = isKeepAliveRequested() && _requestCount + 1 < HTTPS_KEEPALIVE_MAX_REQUESTS;
+  _requestCount++;
+  bool notModified = !entry->etag.empty() &&
+    entityTagMatches(_httpHeaders->getValue(HEADER_IF_NONE_MATCH), entry->etag);
+
+  // Only the header is assembled, the body is sent from the entry
+  std::string header;
+  header.reserve(entry->header.length() + 36);
+  if (notModified) {
+    // A 304 response may contain the Content-Length of the full response (RFC 7230, 3.3.2)
+    header.append("HTTP/1.1 304 Not Modified\r\n");
+    header.append(entry->header, entry->statusLineLength, std::string::npos);
+  } else {
+    header.append(entry->header);
+  }
+  header.append(_isKeepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+  writeBuffers((byte*)header.data(), header.length(),
+    notModified ? NULL : (byte*)entry->body.data(), notModified ? 0 : entry->body.length());
+  if (_isKeepAlive && !isClosed() && (_clientState != CSTATE_CLOSED || getBufferedLength() > 0)) {
+    refreshTimeout();
+    _httpHeaders->clearAll();
+    _connectionState = STATE_INITIAL;
+  } else if (!isClosed()) {
+    _connectionState = STATE_BODY_FINISHED;
+  }
+  return true;
+}
+
 bool HTTPConnection::checkWebsocket() {
   if(_httpMethod == "GET" &&
-     !_httpHeaders->getValue("Host").empty() &&
-      _httpHeaders->getValue("Upgrade") == "websocket" &&
-      _httpHeaders->getValue("Connection").find("Upgrade") != std::string::npos &&
-     !_httpHeaders->getValue("Sec-WebSocket-Key").empty() &&
-      _httpHeaders->getValue("Sec-WebSocket-Version") == "13") {
+     _httpHeaders->get(HEADER_HOST) != NULL &&
+      headerHasToken(_httpHeaders->getValue(HEADER_UPGRADE), "websocket") &&
+      headerHasToken(_httpHeaders->getValue(HEADER_CONNECTION), "upgrade") &&
+     !_httpHeaders->getValue(HEADER_SEC_WEBSOCKET_KEY).empty() &&
+      _httpHeaders->getValue(HEADER_SEC_WEBSOCKET_VERSION) == "13") {
 
       HTTPS_LOGI("Upgrading to WS, FID=%d", _socket);
       return true;
@@ -652,9 +1395,9 @@ void validationMiddleware(HTTPRequest * req, HTTPResponse * res, std::function<v
 void handleWebsocketHandshake(HTTPRequest * req, HTTPResponse * res) {
   res->setStatusCode(101);
   res->setStatusText("Switching Protocols");
-  res->setHeader("Upgrade", "websocket");
-  res->setHeader("Connection", "Upgrade");
-  res->setHeader("Sec-WebSocket-Accept", websocketKeyResponseHash(req->getHeader("Sec-WebSocket-Key")));
+  res->setHeader(HEADER_UPGRADE, "websocket");
+  res->setHeader(HEADER_CONNECTION, "Upgrade");
+  res->setHeader(HEADER_SEC_WEBSOCKET_ACCEPT, websocketKeyResponseHash(req->getHeader(HEADER_SEC_WEBSOCKET_KEY)));
   res->print("");
 }
 
@@ -8,6 +8,7 @@
 #include <mbedtls/base64.h>
 #include <hwcrypto/sha.h>
 #include <functional>
+#include <climits>
 
 // Required for sockets
 #include "lwip/netdb.h"
@@ -16,6 +17,8 @@
 
 #include "HTTPSServerConstants.hpp"
 #include "ConnectionContext.hpp"
+#include "RequestArena.hpp"
+#include "MicroCache.hpp"
 
 #include "HTTPHeaders.hpp"
 #include "HTTPHeader.hpp"
@@ -42,12 +45,32 @@ public:
 
   virtual int initialize(int serverSocketID, HTTPHeaders *defaultHeaders);
   virtual void closeConnection();
+  virtual void reset();
   virtual bool isSecure();
+  virtual bool supportsChunkedEncoding();
   virtual IPAddress getClientIP();
 
   void loop();
   bool isClosed();
   bool isError();
+  bool isFree();
+
+  int getSocket();
+  virtual bool hasPendingWork();
+  unsigned long getRemainingTimeout();
+  void setSocketReadable(bool readable);
+
+  bool isIdle();
+  unsigned long getIdleTime();
+  virtual bool hasPendingOutput();
+  void setSendQueueHighWaterMark(size_t highWaterMark);
+  size_t getSendQueueHighWaterMark();
+  size_t getSendQueueSize();
+  RequestArena * getRequestArena();
+  void setDefaultHeaderBlock(const std::string * block);
+  void setResponseBufferSize(size_t size);
+  void setMicroCache(MicroCache * microCache);
+  void setAutoETag(bool autoETag);
 
 protected:
   friend class HTTPRequest;
@@ -55,9 +78,15 @@ protected:
   friend class WebsocketInputStreambuf;
 
   virtual size_t writeBuffer(byte* buffer, size_t length);
+  virtual size_t writeBuffers(byte* head, size_t headLength, byte* body, size_t bodyLength);
+  virtual int sendBytes(byte* head, size_t headLength, byte* body, size_t bodyLength);
   virtual size_t readBytesToBuffer(byte* buffer, size_t length);
   virtual bool canReadData();
   virtual size_t pendingByteCount();
+  virtual void continueHandshake();
+
+  bool isSendQueueDrained();
+  void discardSendQueue();
 
   // Timestamp of the last transmission action
   unsigned long _lastTransmissionTS;
@@ -67,6 +96,8 @@ protected:
 
   // Internal state machine of the connection:
   //
+  // (TLS connections pass STATE_HANDSHAKE between STATE_UNDEFINED and STATE_INITIAL)
+  //
   // O --- > STATE_UNDEFINED -- initialize() --> STATE_INITIAL -- get / http/1.1 --> STATE_REQUEST_FINISHED --.
   //                     |                          |                                       |                 |
   //                     |                          |                                       |                 | Host: ...\r\n
@@ -84,6 +115,8 @@ protected:
 
     // The connection has not been established yet
     STATE_UNDEFINED,
+    // The TLS handshake is in progress (only used by HTTPSConnection)
+    STATE_HANDSHAKE,
     // The connection has just been created
     STATE_INITIAL,
     // The request line has been parsed
@@ -108,20 +141,45 @@ protected:
     CSTATE_CLOSED
   } _clientState;
 
+  // Result of the server's readiness poll for this socket. It is consumed by the next call to
+  // canReadData(), later calls (e.g. while a handler reads the body) check the socket again.
+  enum {
+    SOCKETSTATE_UNKNOWN,
+    SOCKETSTATE_READABLE,
+    SOCKETSTATE_NOT_READABLE
+  } _socketState;
+
 private:
+  void advanceState();
   void raiseError(uint16_t code, std::string reason);
-  void readLine(int lengthLimit);
+  bool readLine(size_t lengthLimit, const char ** line, size_t * lineLength);
 
   bool isTimeoutExceeded();
   void refreshTimeout();
 
   int updateBuffer();
   size_t pendingBufferSize();
+  bool isInputClosed();
 
   void signalClientClose();
   void signalRequestError();
+  bool queueBuffers(byte* head, size_t headLength, byte* body, size_t bodyLength);
+  bool flushSendQueue();
+  bool waitForSendQueue(size_t limit);
+  void handleSendError();
   size_t readBuffer(byte* buffer, size_t length);
+  const char * getBufferedData();
+  size_t getBufferedLength();
+  void consumeBuffer(size_t length);
   size_t getCacheSize();
+  byte * getResponseBuffer();
+  DeflateEncoder * getDeflateEncoder();
+  bool isKeepAlive();
+  bool isKeepAliveRequested();
+  uint16_t checkTransferEncoding();
+  uint32_t getMicroCacheTTL(HTTPNode * node);
+  std::string getMicroCacheKey();
+  bool sendCachedResponse(HTTPNode * node);
   bool checkWebsocket();
 
   // The receive buffer
@@ -132,6 +190,12 @@ private:
   // The index on the receive_buffer that is the first one which is empty at the end.
   int _bufferUnusedIdx;
 
+  // Outgoing data that could not be written to the socket yet. Everything before
+  // _sendQueueOffset has already been sent.
+  std::string _sendQueue;
+  size_t _sendQueueOffset;
+  size_t _sendQueueHighWaterMark;
+
   // Socket address, length etc for the connection
   struct sockaddr _sockAddr;
   socklen_t _addrLen;
@@ -140,23 +204,46 @@ private:
   // Resource resolver used to resolve resources
   ResourceResolver * _resResolver;
 
-  // The parser line. The struct is used to read the next line up to the \r\n in readLine()
+  // The parser line. The struct is used by readLine() for lines that do not fit into the buffer
   struct {
     std::string text = "";
+    // The previous call to readLine() has returned a complete line
     bool parsingFinished = false;
+    // The buffer contains only an incomplete line, so parsing has to wait for new data
+    bool waitingForData = false;
   } _parserLine;
 
-  // HTTP properties: Method, Request, Headers
+  // HTTP properties: Method, Request, Version, Headers
   std::string _httpMethod;
   std::string _httpResource;
+  std::string _httpVersion;
   HTTPHeaders * _httpHeaders;
 
+  // Memory for the headers and parameters of the current request
+  RequestArena _requestArena;
+
+  // Buffer for keep-alive responses, allocated on first use and reused for every request
+  byte * _responseBuffer;
+  size_t _responseBufferSize;
+
+  // Encoder for compressed responses, allocated on first use and reused for every request
+  DeflateEncoder * _deflateEncoder;
+
   // Default headers that are applied to every response
   HTTPHeaders * _defaultHeaders;
+  // The default headers, serialized by the server
+  const std::string * _defaultHeaderBlock;
+  // Responses of caching nodes, shared by all connections of the server
+  MicroCache * _microCache;
+  // Default for HTTPResponse::setAutoETag()
+  bool _autoETag;
 
   // Should we use keep alive
   bool _isKeepAlive;
 
+  // Number of requests that have been received on this connection
+  uint16_t _requestCount;
+
   //Websocket connection
   WebsocketHandler * _wsHandler;
 
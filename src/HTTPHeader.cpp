@@ -1,17 +1,70 @@
 #include "HTTPHeader.hpp"
 
-#include <locale>
-#include <ostream>
-#include <sstream>
+#include <cctype>
+#include <cstring>
 
 namespace httpsserver {
 
+// Names of the well-known headers, in the order of HTTPHeaderId. They are used instead of the
+// normalized name, so that headers like ETag are sent with their common spelling
+static const char * const WELL_KNOWN_HEADER_NAMES[HEADER_COUNT] = {
+  "Host",
+  "Connection",
+  "Content-Length",
+  "Content-Type",
+  "Content-Encoding",
+  "Transfer-Encoding",
+  "Upgrade",
+  "Authorization",
+  "Accept-Encoding",
+  "ETag",
+  "If-None-Match",
+  "Last-Modified",
+  "If-Modified-Since",
+  "Range",
+  "Sec-WebSocket-Key",
+  "Sec-WebSocket-Version",
+  "Sec-WebSocket-Accept",
+  "Sec-WebSocket-Protocol"
+};
+
+// FNV-1a over the lower-case name. The constexpr variant is used for the case labels in
+// getHeaderId(), so both have to produce the same result.
+static const uint32_t FNV_OFFSET_BASIS = 2166136261u;
+static const uint32_t FNV_PRIME = 16777619u;
+
+static constexpr char lowerCaseChar(char c) {
+  return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+static constexpr uint32_t hashHeaderNameConst(const char * name, uint32_t hash = FNV_OFFSET_BASIS) {
+  return *name == 0 ? hash : hashHeaderNameConst(name + 1, (hash ^ (uint8_t)lowerCaseChar(*name)) * FNV_PRIME);
+}
+
+/**
+ * Returns the spelling of a header name that is used for storing and sending it
+ */
+static std::string canonicalHeaderName(const std::string &name) {
+  HTTPHeaderId id = getHeaderId(name.data(), name.length());
+  return id != HEADER_UNKNOWN ? std::string(getHeaderName(id)) : normalizeHeaderName(name);
+}
+
 HTTPHeader::HTTPHeader(const std::string &name, const std::string &value):
-  _name(normalizeHeaderName(name)),
-  _value(value) {
+  _name(canonicalHeaderName(name)),
+  _value(value),
+  _id(getHeaderId(name.data(), name.length())),
+  _hash(hashHeaderName(name.data(), name.length())) {
     
 }
 
+HTTPHeader::HTTPHeader(HTTPHeaderId id, const std::string &value):
+  _name(getHeaderName(id)),
+  _value(value),
+  _id(id),
+  _hash(hashHeaderNameConst(getHeaderName(id))) {
+
+}
+
 HTTPHeader::~HTTPHeader() {
 
 }
@@ -21,23 +74,68 @@ std::string HTTPHeader::print() {
 }
 
 std::string normalizeHeaderName(std::string const &name) {
-  std::locale loc;
-  std::stringbuf buf;
-  std::ostream oBuf(&buf);
+  std::string normalized(name);
   bool upper = true;
-  std::string::size_type len = name.length();
-  for (std::string::size_type i = 0; i < len; ++i) {
+  for (std::string::size_type i = 0; i < normalized.length(); ++i) {
+    char c = normalized[i];
     if (upper) {
-      oBuf << std::toupper(name[i], loc);
+      normalized[i] = toupper(c);
       upper = false;
     } else {
-      oBuf << std::tolower(name[i], loc);
-      if (!std::isalnum(name[i], loc)) {
-        upper=true;
+      normalized[i] = tolower(c);
+      if (!isalnum(c)) {
+        upper = true;
       }
     }
   }
-  return buf.str();
+  return normalized;
+}
+
+uint32_t hashHeaderName(const char * name, size_t length) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)lowerCaseChar(name[i])) * FNV_PRIME;
+  }
+  return hash;
+}
+
+HTTPHeaderId getHeaderId(const char * name, size_t length) {
+  return getHeaderId(name, length, hashHeaderName(name, length));
+}
+
+HTTPHeaderId getHeaderId(const char * name, size_t length, uint32_t hash) {
+  HTTPHeaderId id;
+  switch (hash) {
+    case hashHeaderNameConst("host"):                   id = HEADER_HOST; break;
+    case hashHeaderNameConst("connection"):             id = HEADER_CONNECTION; break;
+    case hashHeaderNameConst("content-length"):         id = HEADER_CONTENT_LENGTH; break;
+    case hashHeaderNameConst("content-type"):           id = HEADER_CONTENT_TYPE; break;
+    case hashHeaderNameConst("content-encoding"):       id = HEADER_CONTENT_ENCODING; break;
+    case hashHeaderNameConst("transfer-encoding"):      id = HEADER_TRANSFER_ENCODING; break;
+    case hashHeaderNameConst("upgrade"):                id = HEADER_UPGRADE; break;
+    case hashHeaderNameConst("authorization"):          id = HEADER_AUTHORIZATION; break;
+    case hashHeaderNameConst("accept-encoding"):        id = HEADER_ACCEPT_ENCODING; break;
+    case hashHeaderNameConst("etag"):                   id = HEADER_ETAG; break;
+    case hashHeaderNameConst("if-none-match"):          id = HEADER_IF_NONE_MATCH; break;
+    case hashHeaderNameConst("last-modified"):          id = HEADER_LAST_MODIFIED; break;
+    case hashHeaderNameConst("if-modified-since"):      id = HEADER_IF_MODIFIED_SINCE; break;
+    case hashHeaderNameConst("range"):                  id = HEADER_RANGE; break;
+    case hashHeaderNameConst("sec-websocket-key"):      id = HEADER_SEC_WEBSOCKET_KEY; break;
+    case hashHeaderNameConst("sec-websocket-version"):  id = HEADER_SEC_WEBSOCKET_VERSION; break;
+    case hashHeaderNameConst("sec-websocket-accept"):   id = HEADER_SEC_WEBSOCKET_ACCEPT; break;
+    case hashHeaderNameConst("sec-websocket-protocol"): id = HEADER_SEC_WEBSOCKET_PROTOCOL; break;
+    default: return HEADER_UNKNOWN;
+  }
+  // The hash only selects the candidate, the name has to match as well
+  const char * wellKnownName = WELL_KNOWN_HEADER_NAMES[id];
+  if (strlen(wellKnownName) == length && strncasecmp(wellKnownName, name, length) == 0) {
+    return id;
+  }
+  return HEADER_UNKNOWN;
+}
+
+const char * getHeaderName(HTTPHeaderId id) {
+  return (id >= 0 && id < HEADER_COUNT) ? WELL_KNOWN_HEADER_NAMES[id] : "";
 }
 
 } /* namespace httpsserver */
@@ -6,15 +6,47 @@
 
 namespace httpsserver {
 
+/**
+ * \brief IDs of well-known headers, which can be looked up without comparing names
+ */
+enum HTTPHeaderId {
+  HEADER_UNKNOWN = -1,
+  HEADER_HOST = 0,
+  HEADER_CONNECTION,
+  HEADER_CONTENT_LENGTH,
+  HEADER_CONTENT_TYPE,
+  HEADER_CONTENT_ENCODING,
+  HEADER_TRANSFER_ENCODING,
+  HEADER_UPGRADE,
+  HEADER_AUTHORIZATION,
+  HEADER_ACCEPT_ENCODING,
+  HEADER_ETAG,
+  HEADER_IF_NONE_MATCH,
+  HEADER_LAST_MODIFIED,
+  HEADER_IF_MODIFIED_SINCE,
+  HEADER_RANGE,
+  HEADER_SEC_WEBSOCKET_KEY,
+  HEADER_SEC_WEBSOCKET_VERSION,
+  HEADER_SEC_WEBSOCKET_ACCEPT,
+  HEADER_SEC_WEBSOCKET_PROTOCOL,
+  // Number of well-known headers, not a valid ID
+  HEADER_COUNT
+};
+
 /**
  * \brief Represents a single name/value pair of an HTTP header
  */
 class HTTPHeader {
 public:
   HTTPHeader(const std::string &name, const std::string &value);
+  HTTPHeader(HTTPHeaderId id, const std::string &value);
   virtual ~HTTPHeader();
   const std::string _name;
   const std::string _value;
+  // ID of the header if it is well-known, HEADER_UNKNOWN otherwise
+  const HTTPHeaderId _id;
+  // Case-insensitive hash of the name, see hashHeaderName()
+  const uint32_t _hash;
   std::string print();
 };
 
@@ -27,6 +59,26 @@ public:
  */
 std::string normalizeHeaderName(std::string const &name);
 
+/**
+ * \brief Calculates a case-insensitive hash of a header name without allocating memory
+ */
+uint32_t hashHeaderName(const char * name, size_t length);
+
+/**
+ * \brief Returns the ID of a well-known header name (case-insensitive), or HEADER_UNKNOWN
+ */
+HTTPHeaderId getHeaderId(const char * name, size_t length);
+
+/**
+ * \brief Like getHeaderId(name, length), for callers that already have the result of hashHeaderName()
+ */
+HTTPHeaderId getHeaderId(const char * name, size_t length, uint32_t hash);
+
+/**
+ * \brief Returns the name of a well-known header (like "Content-Length" or "ETag")
+ */
+const char * getHeaderName(HTTPHeaderId id);
+
 } /* namespace httpsserver */
 
 #endif /* SRC_HTTPHEADER_HPP_ */
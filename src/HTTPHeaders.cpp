@@ -2,9 +2,13 @@
 
 namespace httpsserver {
 
-HTTPHeaders::HTTPHeaders() {
+HTTPHeaders::HTTPHeaders(RequestArena * arena):
+  _arena(arena) {
   _headers = new std::vector<HTTPHeader *>();
-
+  _headers->reserve(HTTPS_REQUEST_MAX_HEADERS);
+  for(int i = 0; i < HEADER_COUNT; i++) {
+    _wellKnownHeaders[i] = NULL;
+  }
 }
 
 HTTPHeaders::~HTTPHeaders() {
@@ -12,31 +16,54 @@ HTTPHeaders::~HTTPHeaders() {
   delete _headers;
 }
 
+/**
+ * Returns the header with the given name (case-insensitive), or NULL if it is not set
+ */
 HTTPHeader * HTTPHeaders::get(std::string const &name) {
-  std::string normalizedName = normalizeHeaderName(name);
+  uint32_t hash = hashHeaderName(name.data(), name.length());
+  HTTPHeaderId id = getHeaderId(name.data(), name.length(), hash);
+  if (id != HEADER_UNKNOWN) {
+    return _wellKnownHeaders[id];
+  }
   for(std::vector<HTTPHeader*>::iterator header = _headers->begin(); header != _headers->end(); ++header) {
-    if ((*header)->_name.compare(normalizedName)==0) {
+    if ((*header)->_hash == hash && (*header)->_name.length() == name.length() &&
+        strncasecmp((*header)->_name.data(), name.data(), name.length())==0) {
       return (*header);
     }
   }
   return NULL;
 }
 
+/**
+ * Returns a well-known header, or NULL if it is not set
+ */
+HTTPHeader * HTTPHeaders::get(HTTPHeaderId id) {
+  return (id >= 0 && id < HEADER_COUNT) ? _wellKnownHeaders[id] : NULL;
+}
+
 std::string HTTPHeaders::getValue(std::string const &name) {
-  std::string normalizedName = normalizeHeaderName(name);
-  for(std::vector<HTTPHeader*>::iterator header = _headers->begin(); header != _headers->end(); ++header) {
-    if ((*header)->_name.compare(normalizedName)==0) {
-      return ((*header)->_value);
-    }
-  }
-  return "";
+  HTTPHeader * header = get(name);
+  return header != NULL ? header->_value : "";
+}
+
+std::string HTTPHeaders::getValue(HTTPHeaderId id) {
+  HTTPHeader * header = get(id);
+  return header != NULL ? header->_value : "";
 }
 
 
+/**
+ * Adds a header or replaces the existing header with the same name.
+ *
+ * The HTTPHeaders instance takes ownership of the header, which has to be created using new.
+ */
 void HTTPHeaders::set(HTTPHeader * header) {
+  if (header->_id != HEADER_UNKNOWN) {
+    _wellKnownHeaders[header->_id] = header;
+  }
   for(int i = 0; i < _headers->size(); i++) {
-    if ((*_headers)[i]->_name.compare(header->_name)==0) {
-      delete (*_headers)[i];
+    if ((*_headers)[i]->_hash == header->_hash && (*_headers)[i]->_name.compare(header->_name)==0) {
+      releaseHeader((*_headers)[i]);
       (*_headers)[i] = header;
       return;
     }
@@ -44,18 +71,82 @@ void HTTPHeaders::set(HTTPHeader * header) {
   _headers->push_back(header);
 }
 
+/**
+ * Adds a header or replaces the existing header with the same name.
+ *
+ * If the headers belong to a request, the header is placed in the request's arena.
+ */
+void HTTPHeaders::set(std::string const &name, std::string const &value) {
+  HTTPHeader * header = (_arena != NULL ? _arena->create<HTTPHeader>(name, value) : NULL);
+  if (header == NULL) {
+    header = new HTTPHeader(name, value);
+  }
+  set(header);
+}
+
+/**
+ * Adds a well-known header or replaces it, without the need to normalize its name
+ */
+void HTTPHeaders::set(HTTPHeaderId id, std::string const &value) {
+  HTTPHeader * header = (_arena != NULL ? _arena->create<HTTPHeader>(id, value) : NULL);
+  if (header == NULL) {
+    header = new HTTPHeader(id, value);
+  }
+  set(header);
+}
+
+/**
+ * Returns all headers in the order in which they have been set.
+ *
+ * The vector must not be modified, use set() and clearAll() instead.
+ */
 std::vector<HTTPHeader *> * HTTPHeaders::getAll() {
   return _headers;
 }
 
+/**
+ * Returns the length of the header lines that serialize() will produce
+ */
+size_t HTTPHeaders::getSerializedLength() {
+  size_t length = 0;
+  for(std::vector<HTTPHeader*>::iterator header = _headers->begin(); header != _headers->end(); ++header) {
+    length += (*header)->_name.length() + 2 + (*header)->_value.length() + 2;
+  }
+  return length;
+}
+
+/**
+ * Appends all headers to target as they are sent over the wire, like: "Host: myEsp32\r\n"
+ */
+void HTTPHeaders::serialize(std::string &target) {
+  for(std::vector<HTTPHeader*>::iterator header = _headers->begin(); header != _headers->end(); ++header) {
+    target.append((*header)->_name);
+    target.append(": ");
+    target.append((*header)->_value);
+    target.append("\r\n");
+  }
+}
+
 /**
  * Deletes all headers
  */
 void HTTPHeaders::clearAll() {
   for(std::vector<HTTPHeader*>::iterator header = _headers->begin(); header != _headers->end(); ++header) {
-    delete (*header);
+    releaseHeader(*header);
   }
   _headers->clear();
+  for(int i = 0; i < HEADER_COUNT; i++) {
+    _wellKnownHeaders[i] = NULL;
+  }
+}
+
+void HTTPHeaders::releaseHeader(HTTPHeader * header) {
+  if (_arena != NULL && _arena->owns(header)) {
+    // The memory is released together with the arena
+    header->~HTTPHeader();
+  } else {
+    delete header;
+  }
 }
 
 } /* namespace httpsserver */
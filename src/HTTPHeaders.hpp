@@ -9,6 +9,7 @@
 
 #include "HTTPSServerConstants.hpp"
 #include "HTTPHeader.hpp"
+#include "RequestArena.hpp"
 
 namespace httpsserver {
 
@@ -17,19 +18,31 @@ namespace httpsserver {
  */
 class HTTPHeaders {
 public:
-  HTTPHeaders();
+  HTTPHeaders(RequestArena * arena = NULL);
   virtual ~HTTPHeaders();
 
   HTTPHeader * get(std::string const &name);
+  HTTPHeader * get(HTTPHeaderId id);
   std::string getValue(std::string const &name);
+  std::string getValue(HTTPHeaderId id);
   void set(HTTPHeader * header);
+  void set(std::string const &name, std::string const &value);
+  void set(HTTPHeaderId id, std::string const &value);
 
   std::vector<HTTPHeader *> * getAll();
+  size_t getSerializedLength();
+  void serialize(std::string &target);
 
   void clearAll();
 
 private:
+  void releaseHeader(HTTPHeader * header);
+
   std::vector<HTTPHeader*> * _headers;
+  // Index of the well-known headers in _headers, so that they can be found without a search
+  HTTPHeader * _wellKnownHeaders[HEADER_COUNT];
+  // Arena for headers that are created by set(name, value), may be NULL
+  RequestArena * _arena;
 };
 
 } /* namespace httpsserver */
@@ -15,7 +15,7 @@ HTTPMultipartBodyParser::HTTPMultipartBodyParser(HTTPRequest * req):
   fieldMimeType(""),
   fieldFilename("")
 {
-  auto contentType = _request->getHeader("Content-Type");
+  auto contentType = _request->getHeader(HEADER_CONTENT_TYPE);
 #ifdef DEBUG_MULTIPART_PARSER      
   Serial.print("Content type: ");
   Serial.println(contentType.c_str());
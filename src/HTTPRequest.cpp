@@ -16,8 +16,24 @@ HTTPRequest::HTTPRequest(
   _params(params),
   _requestString(requestString) {
 
-  HTTPHeader * contentLength = headers->get("Content-Length");
-  if (contentLength == NULL) {
+  _isChunked = false;
+  _chunkState = CHUNKSTATE_DONE;
+  _chunkRemaining = 0;
+  _chunkLineLength = 0;
+  _chunkExtension = false;
+
+  HTTPHeader * contentLength = headers->get(HEADER_CONTENT_LENGTH);
+  HTTPHeader * transferEncoding = headers->get(HEADER_TRANSFER_ENCODING);
+  if (transferEncoding != NULL) {
+    // Transfer-Encoding overrides Content-Length (RFC 7230, 3.3.3). The connection only accepts
+    // requests that use chunked as the only coding
+    _isChunked = true;
+    _chunkState = CHUNKSTATE_SIZE;
+    _remainingContent = 0;
+    _contentLengthSet = false;
+  } else if (contentLength == NULL) {
+    // Requests without Content-Length have no body (RFC 7230, 3.3.3). Everything that follows
+    // belongs to the next request.
     _remainingContent = 0;
     _contentLengthSet = false;
   } else {
@@ -49,8 +65,15 @@ std::string HTTPRequest::getHeader(std::string const &name) {
   }
 }
 
+/**
+ * Returns the value of a well-known header without searching for its name
+ */
+std::string HTTPRequest::getHeader(HTTPHeaderId id) {
+  return _headers->getValue(id);
+}
+
 void HTTPRequest::setHeader(std::string const &name, std::string const &value) {
-  _headers->set(new HTTPHeader(name, value));
+  _headers->set(name, value);
 }
 
 HTTPNode * HTTPRequest::getResolvedNode() {
@@ -62,9 +85,12 @@ IPAddress HTTPRequest::getClientIP() {
 }
 
 size_t HTTPRequest::readBytes(byte * buffer, size_t length) {
+  if (_isChunked) {
+    return readChunkedBytes(buffer, length);
+  }
 
   // Limit reading to content length
-  if (_contentLengthSet && length > _remainingContent) {
+  if (length > _remainingContent) {
     length = _remainingContent;
   }
 
@@ -73,13 +99,146 @@ size_t HTTPRequest::readBytes(byte * buffer, size_t length) {
     bytesRead = _con->readBuffer(buffer, length);
   }
 
-  if (_contentLengthSet) {
-    _remainingContent -= bytesRead;
+  _remainingContent -= bytesRead;
+  if (bytesRead < length) {
+    checkTruncatedBody();
   }
 
   return bytesRead;
 }
 
+/**
+ * Reads the payload of a chunked body into buffer. The chunk framing is removed on the fly, so
+ * the body is never buffered as a whole.
+ *
+ * Returns the number of bytes that have been read, which may be less than length if no more data
+ * is available at the moment. If the connection ends within the body, the request is complete
+ * afterwards (see checkTruncatedBody()).
+ */
+size_t HTTPRequest::readChunkedBytes(byte * buffer, size_t length) {
+  size_t bytesRead = 0;
+  while (bytesRead < length && _chunkState != CHUNKSTATE_DONE) {
+    if (_chunkState == CHUNKSTATE_DATA) {
+      size_t toRead = std::min(length - bytesRead, _chunkRemaining);
+      size_t res = _con->readBuffer(buffer + bytesRead, toRead);
+      bytesRead += res;
+      _chunkRemaining -= res;
+      if (_chunkRemaining == 0) {
+        _chunkState = CHUNKSTATE_DATA_END;
+      }
+      if (res < toRead) {
+        break;
+      }
+    } else if (!readChunkMetadata()) {
+      break;
+    }
+  }
+  if (bytesRead < length) {
+    checkTruncatedBody();
+  }
+  return bytesRead;
+}
+
+/**
+ * Called if less body data than requested is available. If the connection cannot receive any more
+ * data, the rest of the body will never arrive. The body is then treated as complete, so that
+ * readers like discardRequestBody() do not wait for it forever, and the connection is closed
+ * after the response.
+ */
+void HTTPRequest::checkTruncatedBody() {
+  if (!requestComplete() && _con->isInputClosed()) {
+    HTTPS_LOGW("Connection closed before the request body was complete");
+    _remainingContent = 0;
+    _chunkState = CHUNKSTATE_DONE;
+    _con->signalClientClose();
+  }
+}
+
+/**
+ * Processes the framing between chunk payloads (chunk-size lines, CRLFs and trailers).
+ *
+ * Returns false if it has to wait for more data.
+ */
+bool HTTPRequest::readChunkMetadata() {
+  while (_chunkState != CHUNKSTATE_DATA && _chunkState != CHUNKSTATE_DONE) {
+    // Only check the socket for new data (pendingBufferSize() refills the receive buffer) once the
+    // buffered data has been used up
+    if (_con->getBufferedLength() == 0) {
+      _con->pendingBufferSize();
+      if (_con->getBufferedLength() == 0) {
+        return false;
+      }
+    }
+
+    // The metadata is parsed directly in the receive buffer, like the header lines
+    const char * data = _con->getBufferedData();
+    size_t length = _con->getBufferedLength();
+    size_t processed = 0;
+    bool valid = true;
+    while (valid && processed < length && _chunkState != CHUNKSTATE_DATA && _chunkState != CHUNKSTATE_DONE) {
+      valid = parseChunkMetadata(data[processed++]);
+    }
+    _con->consumeBuffer(processed);
+
+    if (!valid) {
+      _chunkState = CHUNKSTATE_DONE;
+      _con->signalRequestError();
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Processes a single byte of the chunk metadata and updates the chunk state.
+ *
+ * Returns false if the metadata is invalid.
+ */
+bool HTTPRequest::parseChunkMetadata(char c) {
+  // Limit the length of chunk-size and trailer lines, like for header lines
+  if (c != '\n' && ++_chunkLineLength > HTTPS_REQUEST_MAX_HEADER_LENGTH) {
+    HTTPS_LOGW("Chunk metadata too long");
+    return false;
+  }
+
+  switch(_chunkState) {
+  case CHUNKSTATE_SIZE:
+    if (c == '\n' && _chunkLineLength > 0) {
+      _chunkLineLength = 0;
+      _chunkExtension = false;
+      _chunkState = (_chunkRemaining == 0) ? CHUNKSTATE_TRAILER : CHUNKSTATE_DATA;
+    } else if (_chunkExtension || ((c == ';' || c == '\r' || c == ' ' || c == '\t') && _chunkLineLength > 1)) {
+      // Everything after the size (chunk extensions) is ignored
+      _chunkExtension = true;
+    } else if (isxdigit(c) && _chunkLineLength <= 2 * sizeof(uint32_t)) {
+      _chunkRemaining = (_chunkRemaining << 4) | (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+    } else {
+      HTTPS_LOGW("Invalid chunk size");
+      return false;
+    }
+    break;
+  case CHUNKSTATE_DATA_END:
+    if (c == '\n') {
+      _chunkLineLength = 0;
+      _chunkState = CHUNKSTATE_SIZE;
+    } else if (c != '\r') {
+      HTTPS_LOGW("Missing CRLF after chunk");
+      return false;
+    }
+    break;
+  case CHUNKSTATE_TRAILER:
+    // Trailer fields are ignored, the body ends with an empty line
+    if (c == '\n') {
+      _chunkState = (_chunkLineLength <= 1) ? CHUNKSTATE_DONE : CHUNKSTATE_TRAILER;
+      _chunkLineLength = 0;
+    }
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
 size_t HTTPRequest::readChars(char * buffer, size_t length) {
   return readBytes((byte*)buffer, length);
 }
@@ -101,13 +260,11 @@ std::string HTTPRequest::getTag() {
 }
 
 bool HTTPRequest::requestComplete() {
-  if (_contentLengthSet) {
-    // If we have a content size, rely on it.
-    return (_remainingContent == 0);
-  } else {
-    // If there is no more input...
-    return (_con->pendingBufferSize() == 0);
+  if (_isChunked) {
+    return _chunkState == CHUNKSTATE_DONE;
   }
+  // Without Content-Length, the body is empty
+  return (_remainingContent == 0);
 }
 
 /**
@@ -141,7 +298,7 @@ std::string HTTPRequest::getBasicAuthPassword() {
 }
 
 std::string HTTPRequest::decodeBasicAuthToken() {
-  std::string basicAuthString = getHeader("Authorization");
+  std::string basicAuthString = getHeader(HEADER_AUTHORIZATION);
   // Get the length of the token
   size_t sourceLength = basicAuthString.length();
   // Only handle basic auth tokens
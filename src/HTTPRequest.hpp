@@ -4,6 +4,10 @@
 #include <Arduino.h>
 #include <IPAddress.h>
 #include <string>
+// Arduino declares it's own min max, incompatible with the stl...
+#undef min
+#undef max
+#include <algorithm>
 
 #include <mbedtls/base64.h>
 
@@ -25,6 +29,7 @@ public:
   virtual ~HTTPRequest();
 
   std::string getHeader(std::string const &name);
+  std::string getHeader(HTTPHeaderId id);
   void setHeader(std::string const &name, std::string const &value);
   HTTPNode * getResolvedNode();
   std::string getRequestString();
@@ -46,6 +51,10 @@ public:
 
 private:
   std::string decodeBasicAuthToken();
+  size_t readChunkedBytes(byte * buffer, size_t length);
+  bool readChunkMetadata();
+  bool parseChunkMetadata(char c);
+  void checkTruncatedBody();
 
   ConnectionContext * _con;
 
@@ -61,6 +70,27 @@ private:
 
   bool _contentLengthSet;
   size_t _remainingContent;
+
+  // Decoder state for bodies with Transfer-Encoding: chunked
+  bool _isChunked;
+  enum {
+    // Reading the chunk-size line (including chunk extensions)
+    CHUNKSTATE_SIZE,
+    // Reading the payload of a chunk
+    CHUNKSTATE_DATA,
+    // Reading the CRLF after the payload of a chunk
+    CHUNKSTATE_DATA_END,
+    // Reading the trailer section after the last chunk
+    CHUNKSTATE_TRAILER,
+    // The body is complete (or invalid)
+    CHUNKSTATE_DONE
+  } _chunkState;
+  // Remaining bytes of the current chunk
+  size_t _chunkRemaining;
+  // Length of the current chunk-size or trailer line
+  size_t _chunkLineLength;
+  // The rest of the chunk-size line is an extension
+  bool _chunkExtension;
 };
 
 } /* namespace httpsserver */
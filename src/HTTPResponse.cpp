@@ -6,19 +6,32 @@
 namespace httpsserver {
 
 HTTPResponse::HTTPResponse(ConnectionContext * con):
-  _con(con) {
+  _con(con),
+  _headers(con->getRequestArena()) {
 
   // Default status code is 200 OK
   _statusCode = 200;
   _statusText = "OK";
   _headerWritten = false;
   _isError = false;
+  _defaultHeaders = NULL;
+  _defaultHeaderBlock = NULL;
+  _requestHeaders = NULL;
+  _autoETag = false;
+  _compression = false;
+  _encoder = NULL;
+  _microCache = NULL;
+  _microCacheTTL = 0;
+  _isSized = false;
+  _isChunked = false;
+  _chunkOpen = false;
 
+  // The buffer belongs to the connection and is reused for every request
   _responseCacheSize = con->getCacheSize();
   _responseCachePointer = 0;
-  if (_responseCacheSize > 0) {
+  _responseCache = (_responseCacheSize > 0 ? con->getResponseBuffer() : NULL);
+  if (_responseCache != NULL) {
     HTTPS_LOGD("Creating buffered response, size: %d", _responseCacheSize);
-    _responseCache = new byte[_responseCacheSize];
   } else {
     HTTPS_LOGD("Creating non-buffered response");
     _responseCache = NULL;
@@ -26,9 +39,6 @@ HTTPResponse::HTTPResponse(ConnectionContext * con):
 }
 
 HTTPResponse::~HTTPResponse() {
-  if (_responseCache != NULL) {
-    delete[] _responseCache;
-  }
   _headers.clearAll();
 }
 
@@ -49,11 +59,36 @@ std::string HTTPResponse::getStatusText() {
 }
 
 void HTTPResponse::setHeader(std::string const &name, std::string const &value) {
-  _headers.set(new HTTPHeader(name, value));
+  _headers.set(name, value);
+}
+
+/**
+ * Sets a well-known header without the need to normalize its name
+ */
+void HTTPResponse::setHeader(HTTPHeaderId id, std::string const &value) {
+  _headers.set(id, value);
+}
+
+/**
+ * Returns the value of a well-known header without searching for its name
+ */
+std::string HTTPResponse::getHeader(HTTPHeaderId id) {
+  HTTPHeader * h = _headers.get(id);
+  if (h == NULL && _defaultHeaders != NULL) {
+    h = _defaultHeaders->get(id);
+  }
+  return h != NULL ? h->_value : std::string();
 }
 
+/**
+ * Returns the value of a header of this response. If it has not been set, the server's default
+ * header of that name is returned.
+ */
 std::string HTTPResponse::getHeader(std::string const &name) {
   HTTPHeader * h = _headers.get(name);
+  if (h == NULL && _defaultHeaders != NULL) {
+    h = _defaultHeaders->get(name);
+  }
   if (h != NULL) {
     return h->_value;
   } else {
@@ -61,6 +96,15 @@ std::string HTTPResponse::getHeader(std::string const &name) {
   }
 }
 
+/**
+ * Sets the headers that are sent with this response unless the handler overrides them. The block
+ * has to contain defaultHeaders in serialized form (see HTTPHeaders::serialize()).
+ */
+void HTTPResponse::setDefaultHeaders(HTTPHeaders * defaultHeaders, const std::string * defaultHeaderBlock) {
+  _defaultHeaders = defaultHeaders;
+  _defaultHeaderBlock = defaultHeaderBlock;
+}
+
 bool HTTPResponse::isHeaderWritten() {
   return _headerWritten;
 }
@@ -69,12 +113,88 @@ bool HTTPResponse::isResponseBuffered() {
   return _responseCache != NULL;
 }
 
+/**
+ * Returns true, if the response is sent with Transfer-Encoding: chunked
+ */
+bool HTTPResponse::isResponseChunked() {
+  return _isChunked;
+}
+
+/**
+ * Returns true, if the client can find the end of the response without the connection being closed
+ */
+bool HTTPResponse::isResponseLengthKnown() {
+  return isResponseBuffered() || _isChunked || _isSized;
+}
+
+/**
+ * Sets the headers of the request, so that the response can evaluate conditional requests
+ * like If-None-Match
+ */
+void HTTPResponse::setRequestHeaders(HTTPHeaders * requestHeaders) {
+  _requestHeaders = requestHeaders;
+}
+
+/**
+ * Stores the response under key in the micro cache for ttl milliseconds, if it is successful and
+ * the whole body fits into the response buffer
+ */
+void HTTPResponse::setMicroCache(MicroCache * microCache, std::string const &key, uint32_t ttl) {
+  _microCache = microCache;
+  _microCacheKey = key;
+  _microCacheTTL = ttl;
+}
+
 void HTTPResponse::finalize() {
+  if (_encoder != NULL) {
+    // Compress the rest of the body and terminate the compressed data
+    while (!_encoder->finish()) {
+      flushCompressedData();
+    }
+    flushCompressedData();
+  }
   if (isResponseBuffered()) {
     drainBuffer();
+  } else if (!_headerWritten) {
+    // The handler did not write a body
+    if (!_isSized) {
+      if (_statusCode != 204 && _statusCode != 304) {
+        setHeader(HEADER_CONTENT_LENGTH, "0");
+      }
+      startSizedResponse();
+    }
+    printHeader();
+  }
+  if (_isChunked && !_isError) {
+    // Terminate the last chunk and add the last-chunk without trailers
+    if (_chunkOpen) {
+      _con->writeBuffer((byte*)"\r\n0\r\n\r\n", 7);
+    } else {
+      _con->writeBuffer((byte*)"0\r\n\r\n", 5);
+    }
+    _chunkOpen = false;
+    _isChunked = false;
   }
 }
 
+/**
+ * Returns the number of bytes that have been written to the connection but could not be sent yet.
+ *
+ * If this exceeds getSendQueueHighWaterMark(), further writes will block until the client has
+ * received the data. Handlers that stream large responses may check this value to defer work
+ * instead of blocking.
+ */
+size_t HTTPResponse::getSendQueueSize() {
+  return _con->getSendQueueSize();
+}
+
+/**
+ * Returns the size of the send queue up to which writes do not block
+ */
+size_t HTTPResponse::getSendQueueHighWaterMark() {
+  return _con->getSendQueueHighWaterMark();
+}
+
 /**
  * Writes a string to the response. May be called several times.
  */
@@ -82,47 +202,370 @@ void HTTPResponse::printStd(const std::string &str) {
   write((uint8_t*)str.c_str(), str.length());
 }
 
+/**
+ * Announces the length of the body, so that it can be written directly to the client instead of
+ * being buffered, and the connection can still be kept alive.
+ *
+ * Has to be called before anything is written. Afterwards, exactly length bytes have to be written.
+ */
+void HTTPResponse::setContentLength(size_t length) {
+  if (_headerWritten || _responseCachePointer > 0 || _encoder != NULL) {
+    HTTPS_LOGW("Content-Length can only be set before the body is written");
+    return;
+  }
+  setHeader(HEADER_CONTENT_LENGTH, intToString(length));
+  startSizedResponse();
+}
+
+/**
+ * Sends 304 Not Modified (without a body), for clients that already have the current version of
+ * the resource. Headers like ETag should be set before.
+ */
+void HTTPResponse::sendNotModified() {
+  if (_headerWritten) {
+    return;
+  }
+  setStatusCode(304);
+  setStatusText("Not Modified");
+  startSizedResponse();
+  printHeader();
+}
+
+/**
+ * If enabled, a successful response that fits into the response buffer gets an ETag that is
+ * calculated from its body, unless the handler has set one. If the request's If-None-Match matches
+ * it, 304 Not Modified is sent instead of the body.
+ *
+ * The handler still has to create the body, but it is not transmitted (and encrypted) again.
+ */
+void HTTPResponse::setAutoETag(bool autoETag) {
+  _autoETag = autoETag;
+}
+
+/**
+ * Sets the ETag of a buffered response from a hash of its body. Returns true if the client
+ * already has this version of the response.
+ */
+bool HTTPResponse::applyAutoETag() {
+  if (_statusCode != 200 || _isError || _headers.get(HEADER_ETAG) != NULL) {
+    return false;
+  }
+  char etag[24];
+  snprintf(etag, sizeof(etag), "\"%x-%08x\"", (unsigned int)_responseCachePointer,
+    (unsigned int)hashFNV1a(_responseCache, _responseCachePointer));
+  setHeader(HEADER_ETAG, etag);
+  return _requestHeaders != NULL && entityTagMatches(_requestHeaders->getValue(HEADER_IF_NONE_MATCH), etag);
+}
+
+/**
+ * If enabled, the body of the response is compressed with gzip or deflate if the client accepts
+ * one of them (as indicated by Accept-Encoding). The Content-Encoding and Vary headers are set
+ * accordingly. This has to be enabled before the body is written, and has no effect for responses
+ * with a Content-Length set by the handler.
+ *
+ * Compression uses HTTPS_DEFLATE_WINDOW_SIZE, so it reduces text like HTML or JSON, but not data
+ * that is already compressed, like images. It can be enabled for all routes in a middleware function.
+ */
+void HTTPResponse::setCompression(bool compression) {
+  _compression = compression;
+}
+
+/**
+ * Decides on the first write whether the body is compressed, and which content coding is used
+ */
+void HTTPResponse::startCompression() {
+  // The decision is only made once
+  _compression = false;
+  if (_headerWritten || _responseCachePointer > 0 || _isSized || _isError || _statusCode == 204 ||
+      _statusCode == 304 || !getHeader(HEADER_CONTENT_ENCODING).empty() || !getHeader(HEADER_CONTENT_LENGTH).empty()) {
+    return;
+  }
+
+  // Caches must not serve the compressed response to clients that do not support it
+  std::string vary = getHeader("Vary");
+  setHeader("Vary", vary.empty() ? "Accept-Encoding" : vary + ", Accept-Encoding");
+
+  std::string acceptEncoding = (_requestHeaders != NULL ? _requestHeaders->getValue(HEADER_ACCEPT_ENCODING) : "");
+  DeflateEncoder::Format format;
+  std::string coding;
+  if (acceptsEncoding(acceptEncoding, "gzip")) {
+    format = DeflateEncoder::FORMAT_GZIP;
+    coding = "gzip";
+  } else if (acceptsEncoding(acceptEncoding, "deflate")) {
+    format = DeflateEncoder::FORMAT_ZLIB;
+    coding = "deflate";
+  } else {
+    return;
+  }
+  DeflateEncoder * encoder = _con->getDeflateEncoder();
+  if (encoder == NULL || !encoder->begin(format)) {
+    return;
+  }
+  _encoder = encoder;
+  setHeader(HEADER_CONTENT_ENCODING, coding);
+
+  // A strong entity tag of the handler would also match the uncompressed representation
+  std::string etag = getHeader(HEADER_ETAG);
+  if (etag.length() >= 2 && etag[etag.length() - 1] == '"') {
+    setHeader(HEADER_ETAG, etag.substr(0, etag.length() - 1) + "-" + coding + "\"");
+  }
+}
+
+/**
+ * Writes the compressed data that the encoder has produced so far to the body
+ */
+bool HTTPResponse::flushCompressedData() {
+  size_t length = _encoder->getOutputLength();
+  size_t written = (length > 0 ? writeBody(_encoder->getOutput(), length) : 0);
+  _encoder->clearOutput();
+  return written == length;
+}
+
+/**
+ * Passes the buffered response to the micro cache. The Connection header is not stored, as it
+ * depends on the request that is answered from the cache.
+ */
+void HTTPResponse::storeInMicroCache() {
+  // Compressed responses cannot be sent to every client
+  if (_statusCode != 200 || _isError || _encoder != NULL || headerHasToken(getHeader(HEADER_CONNECTION), "close")) {
+    return;
+  }
+  _microCache->put(_microCacheKey, _microCacheTTL, serializeHeader(HEADER_CONNECTION), getHeader(HEADER_ETAG),
+    _responseCache, _responseCachePointer);
+}
+
+/**
+ * Chooses how the client finds the end of a body that is sent before its length is known: HTTP/1.1
+ * clients get it in chunks, so that the connection may stay open, all others by closing the connection.
+ */
+void HTTPResponse::startStreamedResponse() {
+  if (_con->isKeepAlive() && _con->supportsChunkedEncoding() && getHeader(HEADER_CONTENT_LENGTH).empty() &&
+      !headerHasToken(getHeader(HEADER_CONNECTION), "close")) {
+    _isChunked = true;
+    setHeader(HEADER_TRANSFER_ENCODING, "chunked");
+    setHeader(HEADER_CONNECTION, "keep-alive");
+  } else {
+    setHeader(HEADER_CONNECTION, "close");
+  }
+}
+
+/**
+ * Disables the response buffer for a response whose length is known in advance
+ */
+void HTTPResponse::startSizedResponse() {
+  _responseCache = NULL;
+  _isSized = true;
+  // The response buffer would add this header when the response is finalized
+  if (_con->isKeepAlive() && !headerHasToken(getHeader(HEADER_CONNECTION), "close")) {
+    setHeader(HEADER_CONNECTION, "keep-alive");
+  }
+}
+
+/**
+ * Sends a complete response body that stays in memory at least until the call returns, like a
+ * const array in flash.
+ *
+ * The header is sent with the Content-Length of the data, and the data is written directly from
+ * its location in slices of HTTPS_STATIC_SLICE_SIZE bytes instead of being copied into the response
+ * buffer. So the connection can be kept alive regardless of the size of the data.
+ *
+ * If an etag is given, it is sent as ETag header. If the client already has this version (as
+ * indicated by If-None-Match), 304 Not Modified is sent without the body.
+ *
+ * This has to be the only write to the response. Returns the number of body bytes that have been sent.
+ */
+size_t HTTPResponse::sendStatic(const void * data, size_t length, std::string const &contentType, std::string const &etag) {
+  if (_headerWritten || _responseCachePointer > 0 || _encoder != NULL) {
+    // The body has already been started, so the data can only be appended
+    return write((const uint8_t*)data, length);
+  }
+
+  if (!etag.empty()) {
+    // Entity tags are quoted strings
+    std::string entityTag = (etag[0] == '"' || etag.compare(0, 2, "W/") == 0) ? etag : "\"" + etag + "\"";
+    setHeader(HEADER_ETAG, entityTag);
+    if (_requestHeaders != NULL && entityTagMatches(_requestHeaders->getValue(HEADER_IF_NONE_MATCH), entityTag)) {
+      sendNotModified();
+      return 0;
+    }
+  }
+
+  if (!contentType.empty()) {
+    setHeader(HEADER_CONTENT_TYPE, contentType);
+  }
+  setContentLength(length);
+
+  // The first slice is sent together with the header
+  const byte * bytes = (const byte *)data;
+  size_t written = printHeader(bytes, std::min(length, (size_t)HTTPS_STATIC_SLICE_SIZE));
+  while (written > 0 && written < length) {
+    size_t sliceWritten = _con->writeBuffer((byte*)bytes + written, std::min(length - written, (size_t)HTTPS_STATIC_SLICE_SIZE));
+    if (sliceWritten == 0 || sliceWritten == (size_t)-1) {
+      break;
+    }
+    written += sliceWritten;
+  }
+  return written;
+}
+
 /**
  * Writes bytes to the response. May be called several times.
  */
 size_t  HTTPResponse::write(const uint8_t *buffer, size_t size) {
-  if(!isResponseBuffered()) {
-    printHeader();
+  if (_compression) {
+    startCompression();
+  }
+  if (_encoder == NULL) {
+    return writeBody(buffer, size);
+  }
+  size_t consumed = 0;
+  while (consumed < size) {
+    consumed += _encoder->write(buffer + consumed, size - consumed);
+    if (_encoder->isOutputFull() && !flushCompressedData()) {
+      return 0;
+    }
   }
-  return writeBytesInternal(buffer, size);
+  return size;
+}
+
+/**
+ * Writes data to the body as it is transmitted (i.e. after compression)
+ */
+size_t HTTPResponse::writeBody(const void * data, size_t length) {
+  if(!isResponseBuffered() && !_headerWritten) {
+    if (!_isSized) {
+      startStreamedResponse();
+    }
+    // Send the first bytes of the body together with the header
+    return printHeader(data, length);
+  }
+  return writeBytesInternal(data, length);
 }
 
 /**
  * Writes a single byte to the response.
  */
 size_t  HTTPResponse::write(uint8_t b) {
-  if(!isResponseBuffered()) {
-    printHeader();
-  }
   byte ba[] = {b};
-  return writeBytesInternal(ba, 1);
+  return write(ba, 1);
 }
 
 /**
- *  If not already done, writes the header.
+ * If not already done, writes the header.
+ *
+ * The header block is sent with a single write, together with the first bodyLength bytes of
+ * the body (if any). Returns the number of body bytes that have been written.
  */
-void HTTPResponse::printHeader() {
+size_t HTTPResponse::printHeader(const void * body, size_t bodyLength) {
   if (!_headerWritten) {
     HTTPS_LOGD("Printing headers");
+    _headerWritten=true;
 
-    // Status line, like: "HTTP/1.1 200 OK\r\n"
-    std::string statusLine = "HTTP/1.1 " + intToString(_statusCode) + " " + _statusText + "\r\n";
-    printInternal(statusLine, true);
+    if (_isError) {
+      return 0;
+    }
 
-    // Each header, like: "Host: myEsp32\r\n"
-    std::vector<HTTPHeader *> * headers = _headers.getAll();
-    for(std::vector<HTTPHeader*>::iterator header = headers->begin(); header != headers->end(); ++header) {
-      printInternal((*header)->print()+"\r\n", true);
+    std::string header = serializeHeader();
+    if (_isChunked && bodyLength > 0) {
+      // The body starts with the size of the first chunk
+      char chunkSize[12];
+      header.append(chunkSize, snprintf(chunkSize, sizeof(chunkSize), "%x\r\n", (unsigned int)bodyLength));
+      _chunkOpen = true;
     }
-    printInternal("\r\n", true);
+    size_t written = _con->writeBuffers((byte*)header.data(), header.length(), (byte*)body, bodyLength);
+    if (written == (size_t)-1 || written < header.length()) {
+      return 0;
+    }
+    return written - header.length();
+  }
+  return (bodyLength > 0) ? writeBytesInternal(body, bodyLength, true) : 0;
+}
 
-    _headerWritten=true;
+/**
+ * Writes data as a single chunk. The CRLF that terminates a chunk is sent together with the size
+ * of the next chunk (or the last-chunk in finalize()), so each chunk needs only one write.
+ */
+size_t HTTPResponse::writeChunk(const void * data, size_t length) {
+  // An empty chunk would terminate the body
+  if (length == 0) {
+    return 0;
+  }
+  char chunkHeader[16];
+  int chunkHeaderLength = snprintf(chunkHeader, sizeof(chunkHeader), "%s%x\r\n", _chunkOpen ? "\r\n" : "", (unsigned int)length);
+  _chunkOpen = true;
+  size_t written = _con->writeBuffers((byte*)chunkHeader, chunkHeaderLength, (byte*)data, length);
+  if (written == (size_t)-1 || written < (size_t)chunkHeaderLength) {
+    return 0;
+  }
+  return written - chunkHeaderLength;
+}
+
+/**
+ * Returns the status line and all headers, terminated by an empty line.
+ *
+ * If omittedHeader is given, that header of the response is left out.
+ */
+std::string HTTPResponse::serializeHeader(HTTPHeaderId omittedHeader) {
+  std::vector<HTTPHeader *> * headers = _headers.getAll();
+
+  // The pre-serialized default headers can only be used if the handler did not override one of them
+  std::vector<HTTPHeader *> * defaultHeaders = (_defaultHeaders != NULL ? _defaultHeaders->getAll() : NULL);
+  bool useDefaultHeaderBlock = (_defaultHeaderBlock != NULL);
+  if (defaultHeaders != NULL && !defaultHeaders->empty()) {
+    for(std::vector<HTTPHeader*>::iterator header = headers->begin(); useDefaultHeaderBlock && header != headers->end(); ++header) {
+      if (_defaultHeaders->get((*header)->_name) != NULL) {
+        useDefaultHeaderBlock = false;
+      }
+    }
+  }
+
+  // Status line, like: "HTTP/1.1 200 OK\r\n"
+  std::string statusCode = intToString(_statusCode);
+  size_t length = 9 + statusCode.length() + 1 + _statusText.length() + 2 + 2 + _headers.getSerializedLength();
+  if (useDefaultHeaderBlock) {
+    length += _defaultHeaderBlock->length();
+  } else if (defaultHeaders != NULL) {
+    length += _defaultHeaders->getSerializedLength();
+  }
+
+  std::string block;
+  block.reserve(length);
+  block.append("HTTP/1.1 ");
+  block.append(statusCode);
+  block.append(" ");
+  block.append(_statusText);
+  block.append("\r\n");
+
+  // Default headers, unless the handler has set its own value
+  if (useDefaultHeaderBlock) {
+    block.append(*_defaultHeaderBlock);
+  } else if (defaultHeaders != NULL) {
+    for(std::vector<HTTPHeader*>::iterator header = defaultHeaders->begin(); header != defaultHeaders->end(); ++header) {
+      if (_headers.get((*header)->_name) == NULL) {
+        block.append((*header)->_name);
+        block.append(": ");
+        block.append((*header)->_value);
+        block.append("\r\n");
+      }
+    }
   }
+
+  // Each header, like: "Host: myEsp32\r\n"
+  if (omittedHeader == HEADER_UNKNOWN) {
+    _headers.serialize(block);
+  } else {
+    for(std::vector<HTTPHeader*>::iterator header = headers->begin(); header != headers->end(); ++header) {
+      if ((*header)->_id != omittedHeader) {
+        block.append((*header)->_name);
+        block.append(": ");
+        block.append((*header)->_value);
+        block.append("\r\n");
+      }
+    }
+  }
+  block.append("\r\n");
+
+  return block;
 }
 
 /**
@@ -132,33 +575,29 @@ void HTTPResponse::error() {
   _con->signalRequestError();
 }
 
-void HTTPResponse::printInternal(const std::string &str, bool skipBuffer) {
-  writeBytesInternal((uint8_t*)str.c_str(), str.length(), skipBuffer);
-}
-
 size_t HTTPResponse::writeBytesInternal(const void * data, int length, bool skipBuffer) {
   if (!_isError) {
     if (isResponseBuffered() && !skipBuffer) {
       // We are buffering ...
       if(length <= _responseCacheSize - _responseCachePointer) {
         // ... and there is space left in the buffer -> Write to buffer
-        size_t end = _responseCachePointer + length;
-        size_t i = 0;
-        while(_responseCachePointer < end) {
-          _responseCache[_responseCachePointer++] = ((byte*)data)[i++];
-        }
+        memcpy(_responseCache + _responseCachePointer, data, length);
+        _responseCachePointer += length;
         // Returning skips the SSL_write below
         return length;
       } else {
         // .., and the buffer is too small. This is the point where we switch from
         // caching to streaming
         if (!_headerWritten) {
-          setHeader("Connection", "close");
+          startStreamedResponse();
         }
         drainBuffer(true);
       }
     }
 
+    if (_isChunked) {
+      return writeChunk(data, length);
+    }
     return _con->writeBuffer((byte*)data, length);
   } else {
     return 0;
@@ -168,21 +607,26 @@ size_t HTTPResponse::writeBytesInternal(const void * data, int length, bool skip
 void HTTPResponse::drainBuffer(bool onOverflow) {
   if (!_headerWritten) {
     if (_responseCache != NULL && !onOverflow) {
-      _headers.set(new HTTPHeader("Content-Length", intToString(_responseCachePointer)));
+      if (_autoETag && applyAutoETag()) {
+        HTTPS_LOGD("Buffered response not modified");
+        sendNotModified();
+        return;
+      }
+      _headers.set(HEADER_CONTENT_LENGTH, intToString(_responseCachePointer));
+      if (_microCache != NULL) {
+        storeInMicroCache();
+      }
     }
-    printHeader();
-  }
-
-  if (_responseCache != NULL) {
+    // The buffered data (if any) is sent together with the header
     HTTPS_LOGD("Draining response buffer");
-    // Check for 0 as it may be an overflow reaction without any data that has been written earlier
-    if(_responseCachePointer > 0) {
-      // FIXME: Return value?
-      _con->writeBuffer((byte*)_responseCache, _responseCachePointer);
-    }
-    delete[] _responseCache;
-    _responseCache = NULL;
+    printHeader(_responseCache, _responseCachePointer);
+  } else if (_responseCache != NULL && _responseCachePointer > 0) {
+    // FIXME: Return value?
+    _con->writeBuffer((byte*)_responseCache, _responseCachePointer);
   }
+
+  // From now on, the response is streamed
+  _responseCache = NULL;
 }
 
 } /* namespace httpsserver */
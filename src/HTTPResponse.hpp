@@ -8,6 +8,7 @@
 #undef max
 #undef write
 #include <vector>
+#include <algorithm>
 
 #include <openssl/ssl.h>
 
@@ -16,6 +17,7 @@
 #include "ConnectionContext.hpp"
 #include "HTTPHeaders.hpp"
 #include "HTTPHeader.hpp"
+#include "MicroCache.hpp"
 
 namespace httpsserver {
 
@@ -32,10 +34,20 @@ public:
   uint16_t getStatusCode();
   std::string getStatusText();
   void setHeader(std::string const &name, std::string const &value);
+  void setHeader(HTTPHeaderId id, std::string const &value);
   std::string getHeader(std::string const &name);
+  std::string getHeader(HTTPHeaderId id);
   bool isHeaderWritten();
+  void setDefaultHeaders(HTTPHeaders * defaultHeaders, const std::string * defaultHeaderBlock);
+  void setRequestHeaders(HTTPHeaders * requestHeaders);
+  void setMicroCache(MicroCache * microCache, std::string const &key, uint32_t ttl);
+  void setAutoETag(bool autoETag);
+  void setCompression(bool compression);
 
   void printStd(std::string const &str);
+  size_t sendStatic(const void * data, size_t length, std::string const &contentType, std::string const &etag = "");
+  void setContentLength(size_t length);
+  void sendNotModified();
 
   // From Print:
   size_t write(const uint8_t *buffer, size_t size);
@@ -44,22 +56,64 @@ public:
   void error();
 
   bool isResponseBuffered();
+  bool isResponseChunked();
+  bool isResponseLengthKnown();
   void finalize();
 
+  size_t getSendQueueSize();
+  size_t getSendQueueHighWaterMark();
+
   ConnectionContext * _con;
   
 private:
-  void printHeader();
-  void printInternal(const std::string &str, bool skipBuffer = false);
+  size_t printHeader(const void * body = NULL, size_t bodyLength = 0);
+  size_t writeBody(const void * data, size_t length);
+  std::string serializeHeader(HTTPHeaderId omittedHeader = HEADER_UNKNOWN);
   size_t writeBytesInternal(const void * data, int length, bool skipBuffer = false);
   void drainBuffer(bool onOverflow = false);
+  void startSizedResponse();
+  void startStreamedResponse();
+  void storeInMicroCache();
+  bool applyAutoETag();
+  void startCompression();
+  bool flushCompressedData();
+  size_t writeChunk(const void * data, size_t length);
 
   uint16_t _statusCode;
   std::string _statusText;
   HTTPHeaders _headers;
   bool _headerWritten;
+
+  // Headers of the server that are sent with every response, unless they are set for this response.
+  // The block contains them in serialized form, so usually it can be sent as it is
+  HTTPHeaders * _defaultHeaders;
+  const std::string * _defaultHeaderBlock;
   bool _isError;
 
+  // Headers of the request, used to evaluate conditional requests
+  HTTPHeaders * _requestHeaders;
+
+  // Create an ETag from the buffered body, see setAutoETag()
+  bool _autoETag;
+
+  // Compress the body if the client supports it, see setCompression()
+  bool _compression;
+  // The encoder of the connection, if the body is compressed
+  DeflateEncoder * _encoder;
+
+  // Cache in which the complete response is stored, if the node uses caching
+  MicroCache * _microCache;
+  std::string _microCacheKey;
+  uint32_t _microCacheTTL;
+
+  // The length of the body has been sent with the header (or there is no body)
+  bool _isSized;
+
+  // Chunked transfer encoding is used for responses that outgrow the cache
+  bool _isChunked;
+  // A chunk has been written, but its terminating CRLF is still missing
+  bool _chunkOpen;
+
   // Response cache
   byte * _responseCache;
   size_t _responseCacheSize;
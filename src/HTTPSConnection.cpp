@@ -6,13 +6,28 @@ namespace httpsserver {
 HTTPSConnection::HTTPSConnection(ResourceResolver * resResolver):
   HTTPConnection(resResolver) {
   _ssl = NULL;
+  _sslNet.fd = -1;
+  _handshakeWantRead = false;
+  _handshakeWantWrite = false;
+  _sslWriteRetryLength = 0;
 }
 
 HTTPSConnection::~HTTPSConnection() {
-  // Close the socket
+  // Close the socket, there is no time left to send queued data
+  discardSendQueue();
   closeConnection();
 }
 
+void HTTPSConnection::reset() {
+  HTTPConnection::reset();
+  // The SSL context has already been freed by closeConnection()
+  _ssl = NULL;
+  _sslNet.fd = -1;
+  _handshakeWantRead = false;
+  _handshakeWantWrite = false;
+  _sslWriteRetryLength = 0;
+}
+
 bool HTTPSConnection::isSecure() {
   return true;
 }
@@ -21,8 +36,12 @@ bool HTTPSConnection::isSecure() {
  * Initializes the connection from a server socket.
  *
  * The call WILL BLOCK if accept(serverSocketID) blocks. So use select() to check for that in advance.
+ *
+ * The TLS handshake is not performed here. The connection is left in STATE_HANDSHAKE and the
+ * handshake is advanced by loop() whenever the socket is ready, so a slow client does not block the
+ * server.
  */
-int HTTPSConnection::initialize(int serverSocketID, SSL_CTX * sslCtx, HTTPHeaders *defaultHeaders) {
+int HTTPSConnection::initialize(int serverSocketID, mbedtls_ssl_config * sslConfig, HTTPHeaders *defaultHeaders) {
   if (_connectionState == STATE_UNDEFINED) {
     // Let the base class connect the plain tcp socket
     int resSocket = HTTPConnection::initialize(serverSocketID, defaultHeaders);
@@ -30,29 +49,22 @@ int HTTPSConnection::initialize(int serverSocketID, SSL_CTX * sslCtx, HTTPHeader
     // Build up SSL Connection context if the socket has been created successfully
     if (resSocket >= 0) {
 
-      _ssl = SSL_new(sslCtx);
-
-      if (_ssl) {
-        // Bind SSL to the socket
-        int success = SSL_set_fd(_ssl, resSocket);
-        if (success) {
-
-          // Perform the handshake
-          success = SSL_accept(_ssl);
-          if (success) {
-            return resSocket;
-          } else {
-            HTTPS_LOGE("SSL_accept failed. Aborting handshake. FID=%d", resSocket);
-          }
-        } else {
-          HTTPS_LOGE("SSL_set_fd failed. Aborting handshake. FID=%d", resSocket);
-        }
+      mbedtls_ssl_init(&_sslContext);
+      _ssl = &_sslContext;
+
+      if (mbedtls_ssl_setup(_ssl, sslConfig) == 0) {
+        // Bind SSL to the socket. It is non-blocking, so mbedtls returns instead of waiting for the client
+        _sslNet.fd = resSocket;
+        mbedtls_ssl_set_bio(_ssl, &_sslNet, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+        _connectionState = STATE_HANDSHAKE;
+        _handshakeWantRead = false;
+        _handshakeWantWrite = false;
+        return resSocket;
       } else {
-        HTTPS_LOGE("SSL_new failed. Aborting handshake. FID=%d", resSocket);
+        HTTPS_LOGE("mbedtls_ssl_setup failed. Aborting handshake. FID=%d", resSocket);
       }
 
-    } else {
-      HTTPS_LOGE("Could not accept() new connection. FID=%d", resSocket);
     }
 
     _connectionState = STATE_ERROR;
@@ -66,9 +78,59 @@ int HTTPSConnection::initialize(int serverSocketID, SSL_CTX * sslCtx, HTTPHeader
   return -1;
 }
 
+/**
+ * Performs the next step of the TLS handshake. Called by loop() while in STATE_HANDSHAKE.
+ *
+ * Only a single step (like processing the ClientHello or sending the certificate) is performed per
+ * call, so that the other connections are served in the meantime.
+ */
+void HTTPSConnection::continueHandshake() {
+  int socket = getSocket();
+  int res = mbedtls_ssl_handshake_step(_ssl);
+  _handshakeWantRead = (res == MBEDTLS_ERR_SSL_WANT_READ);
+  _handshakeWantWrite = (res == MBEDTLS_ERR_SSL_WANT_WRITE);
+  if (_handshakeWantRead || _handshakeWantWrite) {
+    // Wait until the socket is ready again. The handshake timeout is checked by loop()
+    return;
+  }
+
+  if (res != 0) {
+    HTTPS_LOGE("TLS handshake failed (error -0x%04x). Aborting handshake. FID=%d", -res, socket);
+    _connectionState = STATE_ERROR;
+    closeConnection();
+  } else if (_ssl->state == MBEDTLS_SSL_HANDSHAKE_OVER) {
+    HTTPS_LOGD("Handshake done. FID=%d", socket);
+    _connectionState = STATE_INITIAL;
+    _lastTransmissionTS = millis();
+  }
+}
+
+/**
+ * Returns true, if loop() has to be called even if there is no new data on the socket. This
+ * includes a handshake that can continue with the next step right away.
+ */
+bool HTTPSConnection::hasPendingWork() {
+  if (_connectionState == STATE_HANDSHAKE && !_handshakeWantRead && !_handshakeWantWrite) {
+    return true;
+  }
+  return HTTPConnection::hasPendingWork();
+}
+
+/**
+ * Returns true, if loop() has to be called as soon as the socket is writable, which includes a
+ * handshake that could not be continued as the socket was not ready for writing
+ */
+bool HTTPSConnection::hasPendingOutput() {
+  return (_connectionState == STATE_HANDSHAKE && _handshakeWantWrite) || HTTPConnection::hasPendingOutput();
+}
 
 void HTTPSConnection::closeConnection() {
 
+  // An incomplete handshake cannot be shut down gracefully
+  if (_connectionState == STATE_HANDSHAKE) {
+    _connectionState = STATE_ERROR;
+  }
+
   // FIXME: Copy from HTTPConnection, could be done better probably
   if (_connectionState != STATE_ERROR && _connectionState != STATE_CLOSED) {
 
@@ -82,18 +144,22 @@ void HTTPSConnection::closeConnection() {
     _connectionState = STATE_CLOSING;
   }
 
+  // Everything that has been written should reach the client before SSL is shut down
+  if (!isSendQueueDrained()) {
+    return;
+  }
+
   // Try to tear down SSL while we are in the _shutdownTS timeout period or if an error occurred
   if (_ssl) {
-    if(_connectionState == STATE_ERROR || SSL_shutdown(_ssl) == 0) {
-      // SSL_shutdown will return 1 as soon as the client answered with close notify
-      // This means we are safe to close the socket
-      SSL_free(_ssl);
+    if(_connectionState == STATE_ERROR || mbedtls_ssl_close_notify(_ssl) == 0) {
+      // The close notification has been sent, so we are safe to close the socket
+      mbedtls_ssl_free(_ssl);
       _ssl = NULL;
     } else if (_shutdownTS + HTTPS_SHUTDOWN_TIMEOUT < millis()) {
       // The timeout has been hit, we force SSL shutdown now by freeing the context
-      SSL_free(_ssl);
+      mbedtls_ssl_free(_ssl);
       _ssl = NULL;
-      HTTPS_LOGW("SSL_shutdown did not receive close notification from the client");
+      HTTPS_LOGW("Could not send the close notification to the client");
       _connectionState = STATE_ERROR;
     }
   }
@@ -104,20 +170,91 @@ void HTTPSConnection::closeConnection() {
   }
 }
 
-size_t HTTPSConnection::writeBuffer(byte* buffer, size_t length) {
-  return SSL_write(_ssl, buffer, length);
+/**
+ * Sends data without blocking.
+ *
+ * If both buffers fit into the write buffer of the connection, they are combined, so that they end
+ * up in the same TLS record. Otherwise, they are written one after the other without copying them.
+ *
+ * Returns the number of bytes that have been sent, 0 if the socket is not ready or -1 on error.
+ */
+int HTTPSConnection::sendBytes(byte* head, size_t headLength, byte* body, size_t bodyLength) {
+  if (_ssl == NULL) {
+    return -1;
+  }
+
+  if (bodyLength > 0 && headLength + bodyLength <= HTTPS_TLS_WRITE_BUFFER_SIZE) {
+    memcpy(_sslWriteBuffer, head, headLength);
+    memcpy(_sslWriteBuffer + headLength, body, bodyLength);
+    return writeSSL(_sslWriteBuffer, headLength + bodyLength);
+  }
+
+  int written = 0;
+  if (headLength > 0) {
+    written = writeSSL(head, headLength);
+    if (written < (int)headLength) {
+      return written;
+    }
+  }
+  if (bodyLength > 0) {
+    int res = writeSSL(body, bodyLength);
+    if (res < 0) {
+      return -1;
+    }
+    written += res;
+  }
+  return written;
 }
 
+/**
+ * Writes a buffer with a single mbedtls_ssl_write() without blocking.
+ *
+ * Returns the number of bytes that have been sent, 0 if the socket is not ready or -1 on error.
+ */
+int HTTPSConnection::writeSSL(byte* data, size_t length) {
+  // After mbedtls_ssl_write() could not finish, it has to be called again with the same data. As the
+  // data is at the start of the send queue, we only need to make sure that the length matches.
+  if (_sslWriteRetryLength > 0 && length > _sslWriteRetryLength) {
+    length = _sslWriteRetryLength;
+  }
+
+  int res = mbedtls_ssl_write(_ssl, data, length);
+  if (res > 0) {
+    _sslWriteRetryLength = 0;
+    return res;
+  }
+  if (res == MBEDTLS_ERR_SSL_WANT_WRITE || res == MBEDTLS_ERR_SSL_WANT_READ) {
+    _sslWriteRetryLength = length;
+    return 0;
+  }
+  return -1;
+}
+
+/**
+ * Reads data without blocking. If no complete record is available yet, errno is set to
+ * EWOULDBLOCK like for a plain socket.
+ */
 size_t HTTPSConnection::readBytesToBuffer(byte* buffer, size_t length) {
-  return SSL_read(_ssl, buffer, length);
+  int res = mbedtls_ssl_read(_ssl, buffer, length);
+  if (res <= 0) {
+    if (res == MBEDTLS_ERR_SSL_WANT_READ || res == MBEDTLS_ERR_SSL_WANT_WRITE) {
+      errno = EWOULDBLOCK;
+      return -1;
+    } else if (res == 0 || res == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY || res == MBEDTLS_ERR_SSL_CONN_EOF) {
+      return 0;
+    }
+    errno = EIO;
+    return -1;
+  }
+  return res;
 }
 
 size_t HTTPSConnection::pendingByteCount() {
-  return SSL_pending(_ssl);
+  return mbedtls_ssl_get_bytes_avail(_ssl);
 }
 
 bool HTTPSConnection::canReadData() {
-  return HTTPConnection::canReadData() || (SSL_pending(_ssl) > 0);
+  return HTTPConnection::canReadData() || (mbedtls_ssl_get_bytes_avail(_ssl) > 0);
 }
 
 } /* namespace httpsserver */
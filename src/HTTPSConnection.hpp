@@ -6,8 +6,8 @@
 #include <string>
 
 // Required for SSL
-#include "openssl/ssl.h"
-#undef read
+#include <mbedtls/ssl.h>
+#include <mbedtls/net_sockets.h>
 
 // Required for sockets
 #include "lwip/netdb.h"
@@ -34,9 +34,12 @@ public:
   HTTPSConnection(ResourceResolver * resResolver);
   virtual ~HTTPSConnection();
 
-  virtual int initialize(int serverSocketID, SSL_CTX * sslCtx, HTTPHeaders *defaultHeaders);
+  virtual int initialize(int serverSocketID, mbedtls_ssl_config * sslConfig, HTTPHeaders *defaultHeaders);
   virtual void closeConnection();
+  virtual void reset();
   virtual bool isSecure();
+  virtual bool hasPendingWork();
+  virtual bool hasPendingOutput();
 
 protected:
   friend class HTTPRequest;
@@ -45,11 +48,26 @@ protected:
   virtual size_t readBytesToBuffer(byte* buffer, size_t length);
   virtual size_t pendingByteCount();
   virtual bool canReadData();
-  virtual size_t writeBuffer(byte* buffer, size_t length);
+  virtual int sendBytes(byte* head, size_t headLength, byte* body, size_t bodyLength);
+  virtual void continueHandshake();
 
 private:
-  // SSL context for this connection
-  SSL * _ssl;
+  int writeSSL(byte* data, size_t length);
+
+  // SSL context for this connection. Points to _sslContext while the context is set up, NULL otherwise
+  mbedtls_ssl_context * _ssl;
+  mbedtls_ssl_context _sslContext;
+  // Socket as it is passed to the send and receive functions of mbedtls
+  mbedtls_net_context _sslNet;
+
+  // The handshake has to be continued as soon as the socket can be read or written again
+  bool _handshakeWantRead;
+  bool _handshakeWantWrite;
+
+  // Length of the last mbedtls_ssl_write() that has to be repeated as the socket was not ready
+  size_t _sslWriteRetryLength;
+  // Combines small headers and bodies into one record, see sendBytes()
+  byte _sslWriteBuffer[HTTPS_TLS_WRITE_BUFFER_SIZE];
 
 };
 
@@ -8,11 +8,13 @@ HTTPSServer::HTTPSServer(SSLCert * cert, const uint16_t port, const uint8_t maxC
   _cert(cert) {
 
   // Configure runtime data
-  _sslctx = NULL;
+  _rngLock = xSemaphoreCreateMutex();
 }
 
 HTTPSServer::~HTTPSServer() {
-
+  if (_rngLock != NULL) {
+    vSemaphoreDelete(_rngLock);
+  }
 }
 
 /**
@@ -27,8 +29,7 @@ uint8_t HTTPSServer::setupSocket() {
 
     if (!setupCert()) {
       Serial.println("setupCert failed");
-      SSL_CTX_free(_sslctx);
-      _sslctx = NULL;
+      teardownSSLCTX();
       return 0;
     }
 
@@ -36,8 +37,7 @@ uint8_t HTTPSServer::setupSocket() {
       return 1;
     } else {
       Serial.println("setupSockets failed");
-      SSL_CTX_free(_sslctx);
-      _sslctx = NULL;
+      teardownSSLCTX();
       return 0;
     }
   } else {
@@ -50,27 +50,47 @@ void HTTPSServer::teardownSocket() {
   HTTPServer::teardownSocket();
 
   // Tear down the SSL context
-  SSL_CTX_free(_sslctx);
-  _sslctx = NULL;
+  teardownSSLCTX();
 }
 
 int HTTPSServer::createConnection(int idx) {
-  HTTPSConnection * newConnection = new HTTPSConnection(this);
-  _connections[idx] = newConnection;
-  return newConnection->initialize(_socket, _sslctx, &_defaultHeaders);
+  // The pool has been filled by setupConnections(), so this is always a HTTPSConnection
+  HTTPSConnection * connection = static_cast<HTTPSConnection*>(_connections[idx]);
+  return connection->initialize(_socket, &_sslConfig, &_defaultHeaders);
+}
+
+/**
+ * Creates the pool of TLS-enabled connection objects
+ */
+void HTTPSServer::setupConnections() {
+  for(int i = 0; i < _maxConnections; i++) {
+    _connections[i] = new HTTPSConnection(this);
+  }
 }
 
 /**
  * This method configures the ssl context that is used for the server
+ *
+ * mbedtls is used directly (instead of the OpenSSL compatibility layer), so that the connections can
+ * perform the handshake step by step.
  */
 uint8_t HTTPSServer::setupSSLCTX() {
-  _sslctx = SSL_CTX_new(TLSv1_2_server_method());
-  if (_sslctx) {
-    // Set SSL Timeout to 5 minutes
-    SSL_CTX_set_timeout(_sslctx, 300);
+  mbedtls_ssl_config_init(&_sslConfig);
+  mbedtls_x509_crt_init(&_sslCert);
+  mbedtls_pk_init(&_sslKey);
+  mbedtls_entropy_init(&_entropy);
+  mbedtls_ctr_drbg_init(&_ctrDrbg);
+
+  if (_rngLock != NULL &&
+      mbedtls_ctr_drbg_seed(&_ctrDrbg, mbedtls_entropy_func, &_entropy, NULL, 0) == 0 &&
+      mbedtls_ssl_config_defaults(&_sslConfig, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) == 0) {
+    // Only TLS 1.2 is supported
+    mbedtls_ssl_conf_min_version(&_sslConfig, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+    mbedtls_ssl_conf_max_version(&_sslConfig, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+    mbedtls_ssl_conf_rng(&_sslConfig, &HTTPSServer::randomBytes, this);
     return 1;
   } else {
-    _sslctx = NULL;
+    teardownSSLCTX();
     return 0;
   }
 }
@@ -81,22 +101,50 @@ uint8_t HTTPSServer::setupSSLCTX() {
  */
 uint8_t HTTPSServer::setupCert() {
   // Configure the certificate first
-  uint8_t ret = SSL_CTX_use_certificate_ASN1(
-    _sslctx,
-    _cert->getCertLength(),
-    _cert->getCertData()
+  int ret = mbedtls_x509_crt_parse_der(
+    &_sslCert,
+    _cert->getCertData(),
+    _cert->getCertLength()
   );
 
   // Then set the private key accordingly
-  if (ret) {
-    ret = SSL_CTX_use_RSAPrivateKey_ASN1(
-      _sslctx,
+  if (ret == 0) {
+    ret = mbedtls_pk_parse_key(
+      &_sslKey,
       _cert->getPKData(),
-      _cert->getPKLength()
+      _cert->getPKLength(),
+      NULL,
+      0
     );
   }
 
-  return ret;
+  if (ret == 0) {
+    ret = mbedtls_ssl_conf_own_cert(&_sslConfig, &_sslCert, &_sslKey);
+  }
+
+  return (ret == 0) ? 1 : 0;
+}
+
+/**
+ * Frees the ssl context, the certificate and the random number generator
+ */
+void HTTPSServer::teardownSSLCTX() {
+  mbedtls_ssl_config_free(&_sslConfig);
+  mbedtls_x509_crt_free(&_sslCert);
+  mbedtls_pk_free(&_sslKey);
+  mbedtls_ctr_drbg_free(&_ctrDrbg);
+  mbedtls_entropy_free(&_entropy);
+}
+
+/**
+ * Random number generator of the ssl context
+ */
+int HTTPSServer::randomBytes(void * param, unsigned char * output, size_t length) {
+  HTTPSServer * server = (HTTPSServer *)param;
+  xSemaphoreTake(server->_rngLock, portMAX_DELAY);
+  int res = mbedtls_ctr_drbg_random(&server->_ctrDrbg, output, length);
+  xSemaphoreGive(server->_rngLock);
+  return res;
 }
 
 } /* namespace httpsserver */
@@ -8,8 +8,15 @@
 #include <Arduino.h>
 
 // Required for SSL
-#include "openssl/ssl.h"
-#undef read
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/pk.h>
+
+// FreeRTOS for the lock of the random number generator
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 // Internal includes
 #include "HTTPServer.hpp"
@@ -38,17 +45,27 @@ private:
   SSLCert * _cert;
  
   //// Runtime data ============================================
-  SSL_CTX * _sslctx;
-  // Status of the server: Are we running, or not?
+  // TLS configuration that is shared by all connections
+  mbedtls_ssl_config _sslConfig;
+  mbedtls_x509_crt _sslCert;
+  mbedtls_pk_context _sslKey;
+  // Random number generator for the handshakes. Connections may be processed by several workers,
+  // so it is protected by a lock
+  mbedtls_entropy_context _entropy;
+  mbedtls_ctr_drbg_context _ctrDrbg;
+  SemaphoreHandle_t _rngLock;
 
   // Setup functions
   virtual uint8_t setupSocket();
   virtual void teardownSocket();
   uint8_t setupSSLCTX();
   uint8_t setupCert();
+  void teardownSSLCTX();
+  virtual void setupConnections();
 
   // Helper functions
   virtual int createConnection(int idx);
+  static int randomBytes(void * param, unsigned char * output, size_t length);
 };
 
 } /* namespace httpsserver */
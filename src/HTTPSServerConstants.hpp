@@ -65,22 +65,101 @@
 #endif
 
 // Size (in bytes) of the Connection:keep-alive Cache (we need to be able to
-// store-and-forward the response to calculate the content-size)
+// store-and-forward the response to calculate the content-size).
+// May be changed at runtime using HTTPServer::setResponseBufferSize()
 #ifndef HTTPS_KEEPALIVE_CACHESIZE
 #define HTTPS_KEEPALIVE_CACHESIZE              1400
 #endif
 
+// Size (in bytes) of the per-connection arena that holds the headers and parameters of the current
+// request. Requests that need more memory fall back to the heap
+#ifndef HTTPS_REQUEST_ARENA_SIZE
+#define HTTPS_REQUEST_ARENA_SIZE               1024
+#endif
+
+// Size (in bytes) of the slices in which HTTPResponse::sendStatic() writes its data. Each slice is
+// one write (and one TLS record), and the send queue grows by at most one slice beyond its
+// high-water mark while a client is slow
+#ifndef HTTPS_STATIC_SLICE_SIZE
+#define HTTPS_STATIC_SLICE_SIZE                1400
+#endif
+
+// Size (in bytes) of the per-connection buffer in which a TLS connection combines a header with a
+// small body, so that both are sent in one TLS record. Larger bodies are written as a separate record
+// without copying them
+#ifndef HTTPS_TLS_WRITE_BUFFER_SIZE
+#define HTTPS_TLS_WRITE_BUFFER_SIZE            1400
+#endif
+
+// Size (in bytes) of the buffer on the stack that StaticFileNode uses to send files
+#ifndef HTTPS_STATIC_FILE_BUFFER_SIZE
+#define HTTPS_STATIC_FILE_BUFFER_SIZE          1024
+#endif
+
+// Size (in bytes) of the window in which the deflate encoder of a connection searches for repeated
+// data, if compression is enabled for a response. The encoder needs about 4 times as much memory.
+// Must be a power of two between 512 and 32768
+#ifndef HTTPS_DEFLATE_WINDOW_SIZE
+#define HTTPS_DEFLATE_WINDOW_SIZE              1024
+#endif
+
+// Size (in bytes) of the deflate encoder's output buffer. Compressed data is written to the response
+// in blocks of this size
+#ifndef HTTPS_DEFLATE_OUTPUT_SIZE
+#define HTTPS_DEFLATE_OUTPUT_SIZE              512
+#endif
+
+// Size (in bytes) of the server's cache for responses of nodes that use ResourceNode::setMicroCacheTTL().
+// May be changed at runtime using HTTPServer::setMicroCacheSize()
+#ifndef HTTPS_MICRO_CACHE_SIZE
+#define HTTPS_MICRO_CACHE_SIZE                 4096
+#endif
+
+// Maximum number of state machine steps (e.g. parsing a request, running a handler) that a
+// connection may take in one call of HTTPServer::loop() before the other connections get their turn
+#ifndef HTTPS_CONNECTION_WORK_BUDGET
+#define HTTPS_CONNECTION_WORK_BUDGET           8
+#endif
+
 // Timeout for an HTTPS connection without any transmission
 #ifndef HTTPS_CONNECTION_TIMEOUT
 #define HTTPS_CONNECTION_TIMEOUT               20000
 #endif
 
+// Amount of outgoing data (in bytes) that may be queued for a connection whose client does not
+// receive fast enough. Writes that exceed it block until the queue has been drained below this mark.
+// May be changed at runtime using HTTPServer::setSendQueueHighWaterMark()
+#ifndef HTTPS_SEND_QUEUE_HIGH_WATER_MARK
+#define HTTPS_SEND_QUEUE_HIGH_WATER_MARK       4096
+#endif
+
+// Timeout for an idle keep-alive connection that waits for the next request (ms)
+#ifndef HTTPS_KEEPALIVE_TIMEOUT
+#define HTTPS_KEEPALIVE_TIMEOUT                5000
+#endif
+
+// Maximum number of requests that are served on a single keep-alive connection
+#ifndef HTTPS_KEEPALIVE_MAX_REQUESTS
+#define HTTPS_KEEPALIVE_MAX_REQUESTS           100
+#endif
+
+// Timeout for the TLS handshake of a new connection (ms)
+#ifndef HTTPS_HANDSHAKE_TIMEOUT
+#define HTTPS_HANDSHAKE_TIMEOUT                5000
+#endif
+
 // Timeout used to wait for shutdown of SSL connection (ms)
 // (time for the client to return notify close flag) - without it, truncation attacks might be possible
 #ifndef HTTPS_SHUTDOWN_TIMEOUT
 #define HTTPS_SHUTDOWN_TIMEOUT                 5000
 #endif
 
+// Stack size (in bytes) of the worker tasks that process connections if HTTPServer::startWorkers()
+// is used. Request handlers run on these tasks, so this has to be large enough for them and for TLS
+#ifndef HTTPS_WORKER_STACKSIZE
+#define HTTPS_WORKER_STACKSIZE                 8192
+#endif
+
 // Length of a SHA1 hash
 #ifndef HTTPS_SHA1_LENGTH
 #define HTTPS_SHA1_LENGTH                      20
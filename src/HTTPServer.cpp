@@ -10,11 +10,31 @@ HTTPServer::HTTPServer(const uint16_t port, const uint8_t maxConnections, const
 
   // Create space for the connections
   _connections = new HTTPConnection*[maxConnections];
-  for(uint8_t i = 0; i < maxConnections; i++) _connections[i] = NULL;
+  _connectionBusy = new bool[maxConnections];
+  for(uint8_t i = 0; i < maxConnections; i++) {
+    _connections[i] = NULL;
+    _connectionBusy[i] = false;
+  }
+
+  // No worker pool by default
+  _workerCount = 0;
+  _workQueue = NULL;
+  _doneQueue = NULL;
+  _workerTermination = NULL;
 
   // Configure runtime data
   _socket = -1;
+  _wakeupSocket = -1;
   _running = false;
+
+  _sendQueueHighWaterMark = HTTPS_SEND_QUEUE_HIGH_WATER_MARK;
+  _responseBufferSize = HTTPS_KEEPALIVE_CACHESIZE;
+  _autoETag = false;
+
+  // Statistics
+  _deferredAcceptCount = 0;
+  _acceptDeferred = false;
+  _evictedConnectionCount = 0;
 }
 
 HTTPServer::~HTTPServer() {
@@ -27,6 +47,7 @@ HTTPServer::~HTTPServer() {
 
   // Delete connection pointers
   delete[] _connections;
+  delete[] _connectionBusy;
 }
 
 /**
@@ -35,6 +56,9 @@ HTTPServer::~HTTPServer() {
 uint8_t HTTPServer::start() {
   if (!_running) {
     if (setupSocket()) {
+      setupWakeupSocket();
+      setupConnections();
+      _acceptDeferred = false;
       _running = true;
       return 1;
     }
@@ -57,20 +81,20 @@ void HTTPServer::stop() {
     // Set the flag that the server is stopped
     _running = false;
 
+    // Wait for the workers to finish the connections they are processing
+    stopWorkers();
+
     // Clean up the connections
     bool hasOpenConnections = true;
     while(hasOpenConnections) {
       hasOpenConnections = false;
       for(int i = 0; i < _maxConnections; i++) {
-        if (_connections[i] != NULL) {
+        if (!_connections[i]->isFree() && !_connections[i]->isClosed()) {
           _connections[i]->closeConnection();
 
           // Check if closing succeeded. If not, we need to call the close function multiple times
           // and wait for the client
-          if (_connections[i]->isClosed()) {
-            delete _connections[i];
-            _connections[i] = NULL;
-          } else {
+          if (!_connections[i]->isClosed()) {
             hasOpenConnections = true;
           }
         }
@@ -78,6 +102,8 @@ void HTTPServer::stop() {
       delay(1);
     }
 
+    teardownConnections();
+    teardownWakeupSocket();
     teardownSocket();
 
   }
@@ -90,78 +116,483 @@ void HTTPServer::stop() {
  */
 void HTTPServer::setDefaultHeader(std::string name, std::string value) {
   _defaultHeaders.set(new HTTPHeader(name, value));
+
+  // Render the headers once, so that responses can send them as they are
+  std::string block;
+  block.reserve(_defaultHeaders.getSerializedLength());
+  _defaultHeaders.serialize(block);
+  _defaultHeaderBlock.swap(block);
 }
 
 /**
  * The loop method can either be called by periodical interrupt or in the main loop and handles processing
  * of data
+ *
+ * By default, the call returns immediately if there is nothing to do. If timeoutMs is set, the call
+ * blocks until data arrives on a socket, a connection times out, notify() is called or the timeout is
+ * reached. This allows running the server in its own task without busy polling.
  */
-void HTTPServer::loop() {
+void HTTPServer::loop(uint32_t timeoutMs) {
 
   // Only handle requests if the server is still running
   if(!_running) return;
 
-  // Step 1: Process existing connections
-  // Process open connections and store the index of a free connection
-  // (we might use that later on)
+  // Take back the connections that the workers are done with
+  collectFinishedConnections();
+
+  // Step 1: Clean up closed connections and collect the sockets of the open ones
+  // We create a file descriptor set to be able to use a single select() call for the server
+  // socket and all connection sockets. Store the index of a free connection, too (we might
+  // use that later on)
+  fd_set sockfds;
+  FD_ZERO(&sockfds);
+  // Connections with queued output wait for their socket to become writable
+  fd_set writefds;
+  FD_ZERO(&writefds);
+  int maxSocket = -1;
   int freeConnectionIdx = -1;
+  // Whether there is an idle keep-alive connection that could make room for a new one
+  bool idleConnectionAvailable = false;
+  // Time that we may wait for input. Reduced to the time until the next connection needs attention
+  uint32_t waitMs = timeoutMs;
   for (int i = 0; i < _maxConnections; i++) {
-    // Fetch a free index in the pointer array
-    if (_connections[i] == NULL) {
-      freeConnectionIdx = i;
-
-    } else {
-      // if there is a connection (_connections[i]!=NULL), check if its open or closed:
+    // Connections that are being processed by a worker are left alone
+    if (!_connectionBusy[i]) {
+      // if the connection has been closed, recycle it:
       if (_connections[i]->isClosed()) {
-        // if it's closed, clean up:
-        delete _connections[i];
-        _connections[i] = NULL;
+        _connections[i]->reset();
+      }
+
+      if (_connections[i]->isFree()) {
+        // Fetch a free index in the connection array
         freeConnectionIdx = i;
       } else {
-        // if not, process it:
-        _connections[i]->loop();
+        // if it's open, add it to the set:
+        int connectionSocket = _connections[i]->getSocket();
+        if (connectionSocket >= 0) {
+          FD_SET(connectionSocket, &sockfds);
+          if (_connections[i]->hasPendingOutput()) {
+            FD_SET(connectionSocket, &writefds);
+          }
+          maxSocket = std::max(maxSocket, connectionSocket);
+        }
+        if (_connections[i]->isIdle()) {
+          idleConnectionAvailable = true;
+        }
+        if (_connections[i]->hasPendingWork()) {
+          waitMs = 0;
+        } else {
+          waitMs = std::min(waitMs, (uint32_t)_connections[i]->getRemainingTimeout());
+        }
       }
     }
   }
- 
-  // Step 2: Check for new connections
-  // This makes only sense if there is space to store the connection
-  if (freeConnectionIdx > -1) {
-
-    // We create a file descriptor set to be able to use the select function
-    fd_set sockfds;
-    // Out socket is the only socket in this set
-    FD_ZERO(&sockfds);
+
+  // Waiting for new connections makes only sense if there is space to store the connection, or if
+  // an idle connection can be closed to make space. Otherwise, the server socket is only checked
+  // until a waiting client has been counted as deferred, as it would stay readable until a slot
+  // becomes free.
+  if (freeConnectionIdx > -1 || idleConnectionAvailable || !_acceptDeferred) {
     FD_SET(_socket, &sockfds);
+    maxSocket = std::max(maxSocket, _socket);
+  }
 
-    // We define a "immediate" timeout
+  // The wakeup socket allows other tasks to interrupt the wait
+  if (_wakeupSocket >= 0) {
+    FD_SET(_wakeupSocket, &sockfds);
+    maxSocket = std::max(maxSocket, _wakeupSocket);
+  }
+
+  // Step 2: Check all sockets for input at once
+  if (maxSocket >= 0) {
+    // Wait for input up to waitMs (which is 0 by default, so we return immediately)
     timeval timeout;
-    timeout.tv_sec  = 0;
-    timeout.tv_usec = 0; // Return immediately, if possible
+    timeout.tv_sec  = waitMs / 1000;
+    timeout.tv_usec = (waitMs % 1000) * 1000;
 
-    // Wait for input
     // As by 2017-12-14, it seems that FD_SETSIZE is defined as 0x40, but socket IDs now
-    // start at 0x1000, so we need to use _socket+1 here
-    select(_socket + 1, &sockfds, NULL, NULL, &timeout);
+    // start at 0x1000, so we need to use maxSocket+1 here
+    if (select(maxSocket + 1, &sockfds, &writefds, NULL, &timeout) < 0) {
+      FD_ZERO(&sockfds);
+      FD_ZERO(&writefds);
+    }
+  }
 
-    // There is input
-    if (FD_ISSET(_socket, &sockfds)) {
-      int socketIdentifier = createConnection(freeConnectionIdx);
+  // Drain the wakeup notifications, they have served their purpose
+  if (_wakeupSocket >= 0 && FD_ISSET(_wakeupSocket, &sockfds)) {
+    byte notification[8];
+    while(recv(_wakeupSocket, notification, sizeof(notification), MSG_DONTWAIT) > 0);
+  }
 
-      // If initializing did not work, discard the new socket immediately
-      if (socketIdentifier < 0) {
-        delete _connections[freeConnectionIdx];
-        _connections[freeConnectionIdx] = NULL;
+  // Step 3: Process existing connections
+  // Only connections with new data on the socket or with work left from previous calls
+  // (buffered data, pending TLS records, timeouts, ...) need to run their state machine.
+  // If there is a worker pool, the connection is passed to the workers instead.
+  for (int i = 0; i < _maxConnections; i++) {
+    if (!_connectionBusy[i] && !_connections[i]->isFree() && !_connections[i]->isClosed()) {
+      int connectionSocket = _connections[i]->getSocket();
+      bool readable = connectionSocket >= 0 && FD_ISSET(connectionSocket, &sockfds);
+      bool writable = connectionSocket >= 0 && FD_ISSET(connectionSocket, &writefds);
+      if (readable || writable || _connections[i]->hasPendingWork()) {
+        _connections[i]->setSocketReadable(readable);
+        if (_workerCount > 0) {
+          // The queue has space for every connection, so this does not block
+          _connectionBusy[i] = true;
+          if (xQueueSend(_workQueue, &i, 0) != pdTRUE) {
+            // Try again on the next call
+            _connectionBusy[i] = false;
+          }
+        } else {
+          _connections[i]->loop();
+        }
       }
     }
+  }
+
+  // Step 4: Accept new connections
+  // If clients open several connections at once, we accept all of them up to the number of free slots.
+  // The server socket is non-blocking, so accept() fails once there are no more connections.
+  bool acceptPending = FD_ISSET(_socket, &sockfds);
+  int connectionIdx = 0;
+  while (FD_ISSET(_socket, &sockfds)) {
+    // Find the next free slot
+    while (connectionIdx < _maxConnections &&
+      (_connectionBusy[connectionIdx] || !_connections[connectionIdx]->isFree())) {
+      connectionIdx++;
+    }
+    if (connectionIdx >= _maxConnections) {
+      // After the first accept(), it is unknown whether another client is waiting. The next call
+      // of loop() checks that before a connection is closed for it.
+      if (!acceptPending) {
+        break;
+      }
+      // Make space by closing the least recently used idle keep-alive connection
+      connectionIdx = evictIdleConnection();
+    }
+    if (connectionIdx < 0) {
+      HTTPS_LOGD("No free connection slot, deferring accept()");
+      _deferredAcceptCount++;
+      _acceptDeferred = true;
+      break;
+    }
 
+    int socketIdentifier = createConnection(connectionIdx);
+
+    // If initializing did not work, discard the new socket immediately
+    if (socketIdentifier < 0) {
+      _connections[connectionIdx]->reset();
+      break;
+    }
+    _acceptDeferred = false;
+    _connections[connectionIdx]->setSendQueueHighWaterMark(_sendQueueHighWaterMark);
+    _connections[connectionIdx]->setDefaultHeaderBlock(&_defaultHeaderBlock);
+    _connections[connectionIdx]->setResponseBufferSize(_responseBufferSize);
+    _connections[connectionIdx]->setMicroCache(&_microCache);
+    _connections[connectionIdx]->setAutoETag(_autoETag);
+
+    acceptPending = false;
+  }
+}
+
+/**
+ * Closes the idle keep-alive connection that has been waiting for the longest time.
+ *
+ * Returns the index of the slot that is free afterwards, or -1 if there is none.
+ */
+int HTTPServer::evictIdleConnection() {
+  int lruIdx = -1;
+  unsigned long lruIdleTime = 0;
+  for (int i = 0; i < _maxConnections; i++) {
+    if (!_connectionBusy[i] && _connections[i]->isIdle() &&
+        (lruIdx < 0 || _connections[i]->getIdleTime() > lruIdleTime)) {
+      lruIdx = i;
+      lruIdleTime = _connections[i]->getIdleTime();
+    }
+  }
+
+  if (lruIdx < 0) {
+    return -1;
+  }
+
+  HTTPS_LOGI("Closing idle connection to accept a new client. FID=%d", _connections[lruIdx]->getSocket());
+  _evictedConnectionCount++;
+  _connections[lruIdx]->closeConnection();
+
+  // A TLS connection may need some more time for the shutdown, then we have to wait for it
+  if (!_connections[lruIdx]->isClosed()) {
+    return -1;
+  }
+  _connections[lruIdx]->reset();
+  return lruIdx;
+}
+
+/**
+ * Returns how many idle keep-alive connections have been closed because a new client was waiting
+ * and all connection slots were in use.
+ */
+uint32_t HTTPServer::getEvictedConnectionCount() {
+  return _evictedConnectionCount;
+}
+
+/**
+ * Returns how many request objects (headers, parameters, response caches) have been allocated
+ * from the per-connection arenas instead of the heap.
+ */
+uint32_t HTTPServer::getArenaAllocationCount() {
+  uint32_t count = 0;
+  for(int i = 0; i < _maxConnections; i++) {
+    if (_connections[i] != NULL) {
+      count += _connections[i]->getRequestArena()->getAllocationCount();
+    }
+  }
+  return count;
+}
+
+/**
+ * Returns how many request objects did not fit into the per-connection arena and had to be
+ * allocated from the heap. If this grows with every request, increase HTTPS_REQUEST_ARENA_SIZE.
+ */
+uint32_t HTTPServer::getArenaOverflowCount() {
+  uint32_t count = 0;
+  for(int i = 0; i < _maxConnections; i++) {
+    if (_connections[i] != NULL) {
+      count += _connections[i]->getRequestArena()->getOverflowCount();
+    }
+  }
+  return count;
+}
+
+/**
+ * Sets the amount of data (in bytes) that may be queued for a client that does not receive fast
+ * enough. Writes beyond that block until the client has caught up. Applies to new connections.
+ *
+ * Defaults to HTTPS_SEND_QUEUE_HIGH_WATER_MARK.
+ */
+void HTTPServer::setSendQueueHighWaterMark(size_t highWaterMark) {
+  _sendQueueHighWaterMark = highWaterMark;
+}
+
+/**
+ * Sets the size of the buffer (in bytes) that each connection uses to determine the Content-Length
+ * of keep-alive responses. Larger responses are sent in chunks or close the connection.
+ * A size of 0 disables buffering, so every response body is sent that way. Applies to new connections.
+ *
+ * Defaults to HTTPS_KEEPALIVE_CACHESIZE.
+ */
+void HTTPServer::setResponseBufferSize(size_t size) {
+  _responseBufferSize = size;
+}
+
+/**
+ * Enables ETags for all responses that fit into the response buffer. The ETag is a hash of the
+ * body, and clients that send it in If-None-Match get 304 Not Modified without the body.
+ * Handlers can override this for their response with HTTPResponse::setAutoETag(). Applies to new
+ * connections.
+ *
+ * Disabled by default.
+ */
+void HTTPServer::setAutoETag(bool autoETag) {
+  _autoETag = autoETag;
+}
+
+/**
+ * Sets the maximum amount of memory (in bytes) that is used to store responses of nodes that use
+ * ResourceNode::setMicroCacheTTL(). Least recently used responses are removed to stay below that.
+ *
+ * Defaults to HTTPS_MICRO_CACHE_SIZE.
+ */
+void HTTPServer::setMicroCacheSize(size_t size) {
+  _microCache.setSize(size);
+}
+
+/**
+ * Removes all responses from the micro cache, so that the next requests are handled by their
+ * nodes again. Can be used if the data of a cached response has changed before its TTL expired.
+ */
+void HTTPServer::clearMicroCache() {
+  _microCache.clear();
+}
+
+/**
+ * Returns how many requests have been answered from the micro cache
+ */
+uint32_t HTTPServer::getMicroCacheHitCount() {
+  return _microCache.getHitCount();
+}
+
+/**
+ * Returns how many requests to nodes that use the micro cache had to be handled by the node,
+ * because the response was not cached or had expired
+ */
+uint32_t HTTPServer::getMicroCacheMissCount() {
+  return _microCache.getMissCount();
+}
+
+/**
+ * Returns how often a connection could not be accepted because all connection slots were in use.
+ *
+ * The client has to wait until a slot becomes free then. If this happens often, you may want to
+ * increase maxConnections.
+ */
+uint32_t HTTPServer::getDeferredAcceptCount() {
+  return _deferredAcceptCount;
+}
+
+/**
+ * Wakes up a call to loop() that is waiting for input.
+ *
+ * This function may be called from other tasks, for example after a websocket has been closed
+ * or data has been queued for a connection outside of the server's task.
+ */
+void HTTPServer::notify() {
+  if (_wakeupSocket >= 0) {
+    sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    if (getsockname(_wakeupSocket, (struct sockaddr *)&addr, &addrLen) == 0) {
+      byte notification = 1;
+      sendto(_wakeupSocket, &notification, 1, MSG_DONTWAIT, (struct sockaddr *)&addr, addrLen);
+    }
+  }
+}
+
+/**
+ * Starts a pool of worker tasks that process the connections of the server.
+ *
+ * The task that calls loop() will then only wait for activity and accept new connections, while the
+ * state machines of the connections (including the request handlers) run on the workers. This way, a
+ * slow handler does not block other clients and both cores of the ESP32 can be used. The workers are
+ * pinned to the cores in turns. Each connection is processed by at most one worker at a time, but
+ * handler functions for different connections may run in parallel, so they have to be thread-safe.
+ *
+ * The server has to be running. The workers are stopped with stopWorkers() or stop().
+ *
+ * Returns 1 if the workers have been started.
+ */
+uint8_t HTTPServer::startWorkers(uint8_t workerCount, uint32_t stackSize, UBaseType_t priority) {
+  if (!_running || _workerCount > 0 || workerCount == 0) {
+    return 0;
+  }
+
+  // Every connection can be in the queues at most once (plus the termination requests for the
+  // workers), so sending to them will never block
+  _workQueue = xQueueCreate(_maxConnections + workerCount, sizeof(int));
+  _doneQueue = xQueueCreate(_maxConnections, sizeof(int));
+  _workerTermination = xSemaphoreCreateCounting(workerCount, 0);
+  if (_workQueue == NULL || _doneQueue == NULL || _workerTermination == NULL) {
+    HTTPS_LOGE("Could not create worker queue");
+    if (_workQueue != NULL) vQueueDelete(_workQueue);
+    if (_doneQueue != NULL) vQueueDelete(_doneQueue);
+    if (_workerTermination != NULL) vSemaphoreDelete(_workerTermination);
+    _workQueue = NULL;
+    _doneQueue = NULL;
+    _workerTermination = NULL;
+    return 0;
+  }
+
+  for(uint8_t i = 0; i < workerCount; i++) {
+    BaseType_t res = xTaskCreatePinnedToCore(
+      &HTTPServer::workerTask, "https-worker", stackSize, this, priority, NULL, i % portNUM_PROCESSORS
+    );
+    if (res != pdPASS) {
+      HTTPS_LOGE("Could not create worker task %d", i);
+      break;
+    }
+    _workerCount++;
+  }
+
+  if (_workerCount == 0) {
+    vQueueDelete(_workQueue);
+    vQueueDelete(_doneQueue);
+    vSemaphoreDelete(_workerTermination);
+    _workQueue = NULL;
+    _doneQueue = NULL;
+    _workerTermination = NULL;
+    return 0;
+  }
+
+  HTTPS_LOGI("Started %d workers", _workerCount);
+  return 1;
+}
+
+/**
+ * Stops the worker tasks after they have finished the connections they are currently processing.
+ *
+ * Afterwards, loop() processes all connections on its own again. Must be called from the task that
+ * calls loop().
+ */
+void HTTPServer::stopWorkers() {
+  if (_workerCount == 0) {
+    return;
+  }
+
+  // Each worker terminates after receiving -1. As the queue is processed in order, all connections that
+  // have been passed to the workers before will be done when all workers have terminated.
+  int terminate = -1;
+  for(uint8_t i = 0; i < _workerCount; i++) {
+    xQueueSend(_workQueue, &terminate, portMAX_DELAY);
+  }
+  for(uint8_t i = 0; i < _workerCount; i++) {
+    xSemaphoreTake(_workerTermination, portMAX_DELAY);
+  }
+  collectFinishedConnections();
+
+  vQueueDelete(_workQueue);
+  vQueueDelete(_doneQueue);
+  vSemaphoreDelete(_workerTermination);
+  _workQueue = NULL;
+  _doneQueue = NULL;
+  _workerTermination = NULL;
+  _workerCount = 0;
+}
+
+/**
+ * Entry point of the worker tasks. Processes connections from the work queue until it receives -1.
+ */
+void HTTPServer::workerTask(void * param) {
+  HTTPServer * server = (HTTPServer *)param;
+  int idx;
+  while(xQueueReceive(server->_workQueue, &idx, portMAX_DELAY) == pdTRUE && idx >= 0) {
+    server->_connections[idx]->loop();
+    // Hand the connection back to loop(), and wake it up so that it can wait for the socket again
+    xQueueSend(server->_doneQueue, &idx, portMAX_DELAY);
+    server->notify();
+  }
+  xSemaphoreGive(server->_workerTermination);
+  vTaskDelete(NULL);
+}
+
+/**
+ * Marks the connections that the workers have finished processing as available to loop() again
+ */
+void HTTPServer::collectFinishedConnections() {
+  if (_doneQueue == NULL) {
+    return;
+  }
+  int idx;
+  while(xQueueReceive(_doneQueue, &idx, 0) == pdTRUE) {
+    _connectionBusy[idx] = false;
   }
 }
 
 int HTTPServer::createConnection(int idx) {
-  HTTPConnection * newConnection = new HTTPConnection(this);
-  _connections[idx] = newConnection;
-  return newConnection->initialize(_socket, &_defaultHeaders);
+  return _connections[idx]->initialize(_socket, &_defaultHeaders);
+}
+
+/**
+ * Creates the pool of connection objects. They are reused for every client, so that accepting and
+ * closing connections does not need to allocate memory.
+ */
+void HTTPServer::setupConnections() {
+  for(int i = 0; i < _maxConnections; i++) {
+    _connections[i] = new HTTPConnection(this);
+  }
+}
+
+void HTTPServer::teardownConnections() {
+  for(int i = 0; i < _maxConnections; i++) {
+    delete _connections[i];
+    _connections[i] = NULL;
+  }
 }
 
 /**
@@ -183,7 +614,9 @@ uint8_t HTTPServer::setupSocket() {
     int err = bind(_socket, (struct sockaddr* )&_sock_addr, sizeof(_sock_addr));
     if(!err) {
       err = listen(_socket, _maxConnections);
-      if (!err) {
+      // The socket is non-blocking, so that loop() can accept connections until there are no more
+      int flags = err ? -1 : fcntl(_socket, F_GETFL, 0);
+      if (flags >= 0 && fcntl(_socket, F_SETFL, flags | O_NONBLOCK) >= 0) {
         return 1;
       } else {
         close(_socket);
@@ -208,4 +641,35 @@ void HTTPServer::teardownSocket() {
   _socket = -1;
 }
 
+/**
+ * This method prepares the loopback socket that is used by notify()
+ *
+ * The server will still work if this fails, but loop() cannot be interrupted by notify() then.
+ */
+void HTTPServer::setupWakeupSocket() {
+  _wakeupSocket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_wakeupSocket >= 0) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    // Port 0 = let the stack choose a port, notify() will look it up
+    addr.sin_port = 0;
+    if (bind(_wakeupSocket, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      HTTPS_LOGW("Could not bind wakeup socket, notify() will not work");
+      close(_wakeupSocket);
+      _wakeupSocket = -1;
+    }
+  } else {
+    HTTPS_LOGW("Could not create wakeup socket, notify() will not work");
+  }
+}
+
+void HTTPServer::teardownWakeupSocket() {
+  if (_wakeupSocket >= 0) {
+    close(_wakeupSocket);
+    _wakeupSocket = -1;
+  }
+}
+
 } /* namespace httpsserver */
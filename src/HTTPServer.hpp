@@ -7,6 +7,12 @@
 // Arduino stuff
 #include <Arduino.h>
 
+// FreeRTOS for the worker tasks
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
 // Required for sockets
 #include "lwip/netdb.h"
 #undef read
@@ -21,6 +27,7 @@
 #include "ResourceResolver.hpp"
 #include "ResolvedResource.hpp"
 #include "HTTPConnection.hpp"
+#include "MicroCache.hpp"
 
 namespace httpsserver {
 
@@ -36,10 +43,28 @@ public:
   void stop();
   bool isRunning();
 
-  void loop();
+  void loop(uint32_t timeoutMs = 0);
+  void notify();
+
+  uint8_t startWorkers(uint8_t workerCount, uint32_t stackSize = HTTPS_WORKER_STACKSIZE, UBaseType_t priority = 1);
+  void stopWorkers();
 
   void setDefaultHeader(std::string name, std::string value);
 
+  uint32_t getDeferredAcceptCount();
+  uint32_t getEvictedConnectionCount();
+  uint32_t getArenaAllocationCount();
+  uint32_t getArenaOverflowCount();
+
+  void setSendQueueHighWaterMark(size_t highWaterMark);
+  void setResponseBufferSize(size_t size);
+  void setAutoETag(bool autoETag);
+
+  void setMicroCacheSize(size_t size);
+  void clearMicroCache();
+  uint32_t getMicroCacheHitCount();
+  uint32_t getMicroCacheMissCount();
+
 protected:
   // Static configuration. Port, keys, etc. ====================
   // Certificate that should be used (includes private key)
@@ -51,24 +76,64 @@ protected:
   const in_addr_t _bindAddress;
 
   //// Runtime data ============================================
-  // The array of connections that are currently active
+  // The pool of connections. Created on start(), unused connections are in STATE_UNDEFINED
   HTTPConnection ** _connections;
   // Status of the server: Are we running, or not?
   boolean _running;
   // The server socket
   int _socket;
+  // Loopback UDP socket that is used by notify() to wake up a waiting loop() call
+  int _wakeupSocket;
 
   // The server socket address, that our service is bound to
   sockaddr_in _sock_addr;
   // Headers that are included in every response
   HTTPHeaders _defaultHeaders;
+  // The default headers, serialized as they are sent to the client
+  std::string _defaultHeaderBlock;
+  // Responses of nodes that use ResourceNode::setMicroCacheTTL()
+  MicroCache _microCache;
+
+  // Worker pool (only used after startWorkers() has been called)
+  uint8_t _workerCount;
+  // Queue of connection indices that are ready to be processed by a worker
+  QueueHandle_t _workQueue;
+  // Queue of connection indices that the workers have finished processing. Passing the index
+  // through the queue makes the changes of the worker visible to loop() on the other core.
+  QueueHandle_t _doneQueue;
+  // Used by the workers to signal that they have terminated
+  SemaphoreHandle_t _workerTermination;
+  // True for each connection that has been passed to a worker and is not yet done. Only accessed
+  // by the task that calls loop()
+  bool * _connectionBusy;
 
   // Setup functions
   virtual uint8_t setupSocket();
   virtual void teardownSocket();
+  void setupWakeupSocket();
+  void teardownWakeupSocket();
+  virtual void setupConnections();
+  void teardownConnections();
+
+  // High-water mark of the send queue that is applied to new connections
+  size_t _sendQueueHighWaterMark;
+  // Size of the keep-alive response buffer that is applied to new connections
+  size_t _responseBufferSize;
+  // Whether responses get an ETag from their buffered body, applied to new connections
+  bool _autoETag;
+
+  // Statistics: Number of times a connection could not be accepted as all slots were in use
+  uint32_t _deferredAcceptCount;
+  // A waiting connection has been counted as deferred, and nothing has been accepted since then
+  bool _acceptDeferred;
+  // Statistics: Number of idle keep-alive connections that have been closed to accept a new client
+  uint32_t _evictedConnectionCount;
 
   // Helper functions
   virtual int createConnection(int idx);
+  void collectFinishedConnections();
+  int evictIdleConnection();
+  static void workerTask(void * param);
 };
 
 }
@@ -0,0 +1,184 @@
+#include "MicroCache.hpp"
+
+namespace httpsserver {
+
+MicroCache::MicroCache(size_t size):
+  _size(size) {
+  _usedSize = 0;
+  _lock = xSemaphoreCreateMutex();
+  _hitCount = 0;
+  _missCount = 0;
+  _evictionCount = 0;
+}
+
+MicroCache::~MicroCache() {
+  _entries.clear();
+  if (_lock != NULL) {
+    vSemaphoreDelete(_lock);
+  }
+}
+
+/**
+ * Looks up the response for key. If it exists and has not expired, entry is set to it. The entry
+ * stays valid as long as the caller holds the reference, even if it is removed from the cache.
+ *
+ * Returns false if the request has to be handled by its node.
+ */
+bool MicroCache::get(std::string const &key, std::shared_ptr<const Entry> &entry) {
+  bool found = false;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for(std::list<std::shared_ptr<const Entry> >::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+    if ((*it)->key == key) {
+      if (millis() - (*it)->storedTS >= (*it)->ttl) {
+        removeEntry(it);
+      } else {
+        // The entry becomes the most recently used one
+        _entries.splice(_entries.begin(), _entries, it);
+        entry = *it;
+        found = true;
+      }
+      break;
+    }
+  }
+  if (found) {
+    _hitCount++;
+  } else {
+    _missCount++;
+  }
+  xSemaphoreGive(_lock);
+  return found;
+}
+
+/**
+ * Stores a response for ttl milliseconds.
+ *
+ * The header has to contain the status line and all headers except for Connection, terminated by
+ * an empty line (see HTTPResponse::serializeHeader()). The etag is the value of its ETag header,
+ * if any. Responses that are larger than the cache are not stored.
+ */
+void MicroCache::put(std::string const &key, uint32_t ttl, std::string const &header, std::string const &etag,
+    const byte * body, size_t bodyLength) {
+  // The empty line is added by the sender, after the Connection header
+  size_t headerLength = header.length();
+  if (headerLength >= 2 && header.compare(headerLength - 2, 2, "\r\n") == 0) {
+    headerLength -= 2;
+  }
+  size_t statusLineLength = header.find("\r\n");
+  if (statusLineLength == std::string::npos || statusLineLength + 2 > headerLength) {
+    return;
+  }
+
+  if (key.length() + headerLength + bodyLength + etag.length() + sizeof(Entry) > _size) {
+    HTTPS_LOGD("Response for %s exceeds the micro cache size", key.c_str());
+    return;
+  }
+
+  Entry * entry = new Entry();
+  entry->key = key;
+  entry->header.assign(header, 0, headerLength);
+  entry->statusLineLength = statusLineLength + 2;
+  entry->body.assign((const char *)body, bodyLength);
+  entry->etag = etag;
+  entry->storedTS = millis();
+  entry->ttl = ttl;
+  size_t entrySize = getEntrySize(*entry);
+  std::shared_ptr<const Entry> sharedEntry(entry);
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for(std::list<std::shared_ptr<const Entry> >::iterator existing = _entries.begin(); existing != _entries.end(); ++existing) {
+    if ((*existing)->key == key) {
+      removeEntry(existing);
+      break;
+    }
+  }
+  // The size may have been changed in the meantime
+  if (entrySize <= _size) {
+    shrink(_size - entrySize);
+    _entries.push_front(sharedEntry);
+    _usedSize += entrySize;
+  }
+  xSemaphoreGive(_lock);
+}
+
+/**
+ * Removes all entries, e.g. if the data of the cached responses has changed
+ */
+void MicroCache::clear() {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _entries.clear();
+  _usedSize = 0;
+  xSemaphoreGive(_lock);
+}
+
+/**
+ * Sets the maximum size of all entries (in bytes), including the keys and the management overhead.
+ * Least recently used entries are removed if the cache is larger than that.
+ */
+void MicroCache::setSize(size_t size) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _size = size;
+  shrink(size);
+  xSemaphoreGive(_lock);
+}
+
+size_t MicroCache::getSize() {
+  return _size;
+}
+
+/**
+ * Returns the size of all entries that are currently stored
+ */
+size_t MicroCache::getUsedSize() {
+  return _usedSize;
+}
+
+/**
+ * Returns the number of requests that have been answered from the cache
+ */
+uint32_t MicroCache::getHitCount() {
+  return _hitCount;
+}
+
+/**
+ * Returns the number of requests to caching nodes that had to be handled by the node
+ */
+uint32_t MicroCache::getMissCount() {
+  return _missCount;
+}
+
+/**
+ * Returns the number of entries that have been removed before they expired to make space
+ */
+uint32_t MicroCache::getEvictionCount() {
+  return _evictionCount;
+}
+
+size_t MicroCache::getEntrySize(Entry const &entry) {
+  return sizeof(Entry) + entry.key.length() + entry.header.length() + entry.body.length() + entry.etag.length();
+}
+
+/**
+ * Removes an entry. The lock has to be held by the caller. Connections that are sending the entry
+ * keep it until they are done.
+ */
+void MicroCache::removeEntry(std::list<std::shared_ptr<const Entry> >::iterator entry) {
+  _usedSize -= getEntrySize(**entry);
+  _entries.erase(entry);
+}
+
+/**
+ * Removes least recently used entries until at most size bytes are used. The lock has to be held
+ * by the caller.
+ */
+void MicroCache::shrink(size_t size) {
+  while (_usedSize > size && !_entries.empty()) {
+    std::list<std::shared_ptr<const Entry> >::iterator last = _entries.end();
+    --last;
+    if (millis() - (*last)->storedTS < (*last)->ttl) {
+      _evictionCount++;
+    }
+    removeEntry(last);
+  }
+}
+
+} /* namespace httpsserver */
@@ -0,0 +1,87 @@
+#ifndef SRC_MICROCACHE_HPP_
+#define SRC_MICROCACHE_HPP_
+
+#include <Arduino.h>
+
+#include <string>
+// Arduino declares it's own min max, incompatible with the stl...
+#undef min
+#undef max
+#include <list>
+#include <memory>
+#include <utility>
+
+// FreeRTOS for the lock (connections may be processed by several workers)
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "HTTPSServerConstants.hpp"
+
+namespace httpsserver {
+
+/**
+ * \brief Stores complete responses of ResourceNodes that opt into caching
+ *
+ * Each entry contains the status line, the headers (except for Connection) and the body of a
+ * response, keyed by request method and URL. Entries are shared with the connections that send
+ * them, so a hit does not copy the response. Entries expire after the time to live of their node.
+ * If the size of all entries would exceed the configured size, the least recently used entries
+ * are removed.
+ *
+ * The cache belongs to the server and is shared by all connections, so it may be used by several
+ * worker tasks at the same time.
+ */
+class MicroCache {
+public:
+  MicroCache(size_t size = HTTPS_MICRO_CACHE_SIZE);
+  virtual ~MicroCache();
+
+  /**
+   * \brief A stored response, which must not be modified
+   */
+  struct Entry {
+    std::string key;
+    // Status line and headers, without Connection and the terminating empty line
+    std::string header;
+    // Length of the status line including its CRLF
+    size_t statusLineLength;
+    std::string body;
+    // Value of the ETag header, may be empty
+    std::string etag;
+    // Time when the entry has been stored, and for how long it is valid (ms)
+    unsigned long storedTS;
+    uint32_t ttl;
+  };
+
+  bool get(std::string const &key, std::shared_ptr<const Entry> &entry);
+  void put(std::string const &key, uint32_t ttl, std::string const &header, std::string const &etag,
+    const byte * body, size_t bodyLength);
+  void clear();
+
+  void setSize(size_t size);
+  size_t getSize();
+  size_t getUsedSize();
+  uint32_t getHitCount();
+  uint32_t getMissCount();
+  uint32_t getEvictionCount();
+
+private:
+  static size_t getEntrySize(Entry const &entry);
+  void removeEntry(std::list<std::shared_ptr<const Entry> >::iterator entry);
+  void shrink(size_t size);
+
+  // Most recently used entries first
+  std::list<std::shared_ptr<const Entry> > _entries;
+  size_t _size;
+  size_t _usedSize;
+  SemaphoreHandle_t _lock;
+
+  uint32_t _hitCount;
+  uint32_t _missCount;
+  // Entries that have been removed to make space for others
+  uint32_t _evictionCount;
+};
+
+} /* namespace httpsserver */
+
+#endif /* SRC_MICROCACHE_HPP_ */
@@ -0,0 +1,100 @@
+#include "RequestArena.hpp"
+
+namespace httpsserver {
+
+RequestArena::RequestArena(size_t size):
+  _size(size) {
+  _memory = (size > 0 ? new byte[size] : NULL);
+  _offset = 0;
+  _peakOffset = 0;
+  _allocationCount = 0;
+  _overflowCount = 0;
+  _resetCount = 0;
+}
+
+RequestArena::~RequestArena() {
+  if (_memory != NULL) {
+    delete[] _memory;
+  }
+}
+
+/**
+ * Returns size bytes from the arena, aligned for any object type, or NULL if the arena does not
+ * have enough space left. In that case, the caller has to use the heap.
+ */
+void * RequestArena::allocate(size_t size) {
+  const size_t alignment = alignof(std::max_align_t);
+  size_t start = (_offset + alignment - 1) & ~(alignment - 1);
+  if (_memory == NULL || start > _size || size > _size - start) {
+    _overflowCount++;
+    return NULL;
+  }
+  _offset = start + size;
+  if (_offset > _peakOffset) {
+    _peakOffset = _offset;
+  }
+  _allocationCount++;
+  return _memory + start;
+}
+
+/**
+ * Returns true, if ptr points to memory of this arena (and must therefore not be deleted)
+ */
+bool RequestArena::owns(const void * ptr) {
+  return _memory != NULL && (const byte *)ptr >= _memory && (const byte *)ptr < _memory + _size;
+}
+
+/**
+ * Releases all allocations at once. Every object that has been placed in the arena has to be
+ * destroyed before.
+ */
+void RequestArena::reset() {
+  if (_offset > 0) {
+    _offset = 0;
+    _resetCount++;
+  }
+}
+
+/**
+ * Returns the capacity of the arena in bytes
+ */
+size_t RequestArena::getSize() {
+  return _size;
+}
+
+/**
+ * Returns the number of bytes that are currently allocated
+ */
+size_t RequestArena::getUsedSize() {
+  return _offset;
+}
+
+/**
+ * Returns the maximum number of bytes that a single request has used
+ */
+size_t RequestArena::getPeakUsedSize() {
+  return _peakOffset;
+}
+
+/**
+ * Returns the number of allocations that have been served from the arena
+ */
+uint32_t RequestArena::getAllocationCount() {
+  return _allocationCount;
+}
+
+/**
+ * Returns the number of allocations that did not fit into the arena and used the heap instead
+ */
+uint32_t RequestArena::getOverflowCount() {
+  return _overflowCount;
+}
+
+/**
+ * Returns how often the arena has been released after a request
+ */
+uint32_t RequestArena::getResetCount() {
+  return _resetCount;
+}
+
+} /* namespace httpsserver */
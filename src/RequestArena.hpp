@@ -0,0 +1,68 @@
+#ifndef SRC_REQUESTARENA_HPP_
+#define SRC_REQUESTARENA_HPP_
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "HTTPSServerConstants.hpp"
+
+namespace httpsserver {
+
+/**
+ * \brief Bump allocator for objects that live only as long as a single request
+ *
+ * Each connection owns one arena. Headers and resource parameters of a request are placed
+ * in it, and the whole arena is released in one step after the request has
+ * been handled, so that serving requests does not need malloc/free pairs in steady state.
+ *
+ * If a request needs more memory than the arena provides, allocate() returns NULL and the
+ * caller falls back to the heap. The counters can be used to tune HTTPS_REQUEST_ARENA_SIZE.
+ */
+class RequestArena {
+public:
+  RequestArena(size_t size = HTTPS_REQUEST_ARENA_SIZE);
+  virtual ~RequestArena();
+
+  void * allocate(size_t size);
+  bool owns(const void * ptr);
+  void reset();
+
+  /**
+   * Constructs an object of type T in the arena. Returns NULL if the arena is exhausted.
+   *
+   * Objects created this way must be destroyed by calling their destructor explicitly before
+   * the arena is reset, the memory must not be passed to delete.
+   */
+  template<typename T, typename... Args>
+  T * create(Args&&... args) {
+    void * mem = allocate(sizeof(T));
+    return mem == NULL ? NULL : new (mem) T(std::forward<Args>(args)...);
+  }
+
+  size_t getSize();
+  size_t getUsedSize();
+  size_t getPeakUsedSize();
+  uint32_t getAllocationCount();
+  uint32_t getOverflowCount();
+  uint32_t getResetCount();
+
+private:
+  byte * _memory;
+  size_t _size;
+  // Offset of the first unused byte in _memory
+  size_t _offset;
+  size_t _peakOffset;
+
+  // Allocations that have been served from the arena
+  uint32_t _allocationCount;
+  // Allocations that did not fit into the arena and had to use the heap
+  uint32_t _overflowCount;
+  uint32_t _resetCount;
+};
+
+} /* namespace httpsserver */
+
+#endif /* SRC_REQUESTARENA_HPP_ */
@@ -2,16 +2,15 @@
 
 namespace httpsserver {
 
-ResolvedResource::ResolvedResource() {
+ResolvedResource::ResolvedResource(RequestArena * arena):
+  _arena(arena) {
   _matchingNode = NULL;
   _params = NULL;
 }
 
 ResolvedResource::~ResolvedResource() {
   // Delete only params, nodes are reused/server-internal
-  if (_params != NULL) {
-    delete _params;
-  }
+  releaseParams(_params);
 }
 
 bool ResolvedResource::didMatch() {
@@ -31,10 +30,35 @@ ResourceParameters * ResolvedResource::getParams() {
 }
 
 void ResolvedResource::setParams(ResourceParameters * params) {
-  if (_params != NULL && _params!=params) {
-    delete _params;
+  if (_params!=params) {
+    releaseParams(_params);
   }
   _params = params;
 }
 
+/**
+ * Creates an empty parameters object, in the arena of the request if possible.
+ *
+ * It has to be passed to setParams() or releaseParams() afterwards.
+ */
+ResourceParameters * ResolvedResource::createParams() {
+  ResourceParameters * params = (_arena != NULL ? _arena->create<ResourceParameters>() : NULL);
+  return params != NULL ? params : new ResourceParameters();
+}
+
+/**
+ * Destroys a parameters object that has been created by createParams()
+ */
+void ResolvedResource::releaseParams(ResourceParameters * params) {
+  if (params == NULL) {
+    return;
+  }
+  if (_arena != NULL && _arena->owns(params)) {
+    // The memory is released together with the arena
+    params->~ResourceParameters();
+  } else {
+    delete params;
+  }
+}
+
 } /* namespace httpsserver */
@@ -3,6 +3,7 @@
 
 #include "ResourceNode.hpp"
 #include "ResourceParameters.hpp"
+#include "RequestArena.hpp"
 
 namespace httpsserver {
 
@@ -11,7 +12,7 @@ namespace httpsserver {
  */
 class ResolvedResource {
 public:
-  ResolvedResource();
+  ResolvedResource(RequestArena * arena = NULL);
   ~ResolvedResource();
 
   void setMatchingNode(HTTPNode * node);
@@ -19,10 +20,14 @@ public:
   bool didMatch();
   ResourceParameters * getParams();
   void setParams(ResourceParameters * params);
+  ResourceParameters * createParams();
+  void releaseParams(ResourceParameters * params);
 
 private:
   HTTPNode * _matchingNode;
   ResourceParameters * _params;
+  // Arena for the parameters, may be NULL
+  RequestArena * _arena;
 };
 
 } /* namespace httpsserver */
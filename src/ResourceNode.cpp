@@ -6,11 +6,27 @@ ResourceNode::ResourceNode(const std::string &path, const std::string &method, c
   HTTPNode(path, HANDLER_CALLBACK, tag),
   _method(method),
   _callback(callback) {
-
+  _microCacheTTL = 0;
 }
 
 ResourceNode::~ResourceNode() {
   
 }
 
+/**
+ * Lets the server store successful responses to GET requests for this node for ttl milliseconds.
+ * Until then, requests for the same URL are answered from the server's cache, without calling the
+ * middleware or the handler. So this may only be used for responses that do not depend on request
+ * headers (like Authorization) or on anything else than the URL.
+ *
+ * Only responses that fit into the response buffer are cached. 0 disables caching (default).
+ */
+void ResourceNode::setMicroCacheTTL(uint32_t ttl) {
+  _microCacheTTL = ttl;
+}
+
+uint32_t ResourceNode::getMicroCacheTTL() {
+  return _microCacheTTL;
+}
+
 } /* namespace httpsserver */
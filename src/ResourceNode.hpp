@@ -21,6 +21,13 @@ public:
   const std::string _method;
   const HTTPSCallbackFunction * _callback;
   std::string getMethod() { return _method; }
+
+  void setMicroCacheTTL(uint32_t ttl);
+  uint32_t getMicroCacheTTL();
+
+private:
+  // Time (ms) for which responses of this node are cached, 0 = not cached
+  uint32_t _microCacheTTL;
 };
 
 } /* namespace httpsserver */
@@ -31,7 +31,7 @@ void ResourceResolver::resolveNode(const std::string &method, const std::string
   resolvedResource.setParams(NULL);
 
   // Memory management of this object will be performed by the ResolvedResource instance
-  ResourceParameters * params = new ResourceParameters();
+  ResourceParameters * params = resolvedResource.createParams();
 
   // Split URL in resource name and request params. Request params start after an optional '?'
   size_t reqparamIdx = url.find('?');
@@ -156,7 +156,7 @@ void ResourceResolver::resolveNode(const std::string &method, const std::string
     // The resolvedResource now takes care of memory management for the params
     resolvedResource.setParams(params);
   } else {
-    delete params;
+    resolvedResource.releaseParams(params);
   }
 }
 
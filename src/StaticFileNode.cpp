@@ -0,0 +1,269 @@
+#include "StaticFileNode.hpp"
+
+namespace httpsserver {
+
+// Content types by file extension. Files with other extensions are sent as application/octet-stream
+static const char * const CONTENT_TYPES[][2] = {
+  {".html",  "text/html"},
+  {".htm",   "text/html"},
+  {".css",   "text/css"},
+  {".js",    "application/javascript"},
+  {".json",  "application/json"},
+  {".xml",   "application/xml"},
+  {".txt",   "text/plain"},
+  {".png",   "image/png"},
+  {".jpg",   "image/jpeg"},
+  {".jpeg",  "image/jpeg"},
+  {".gif",   "image/gif"},
+  {".svg",   "image/svg+xml"},
+  {".ico",   "image/vnd.microsoft.icon"},
+  {".pdf",   "application/pdf"},
+  {".woff",  "font/woff"},
+  {".woff2", "font/woff2"},
+  {NULL, NULL}
+};
+
+static const char * getContentType(std::string const &path) {
+  for (int i = 0; CONTENT_TYPES[i][0] != NULL; i++) {
+    size_t extLength = strlen(CONTENT_TYPES[i][0]);
+    if (path.length() > extLength && strcasecmp(path.c_str() + path.length() - extLength, CONTENT_TYPES[i][0]) == 0) {
+      return CONTENT_TYPES[i][1];
+    }
+  }
+  return "application/octet-stream";
+}
+
+/**
+ * Parses a decimal number of the Range header. Returns false if it is empty, invalid or too large
+ */
+static bool parseRangeNumber(std::string const &s, size_t start, size_t end, size_t * value) {
+  if (start >= end || end - start > 9) {
+    return false;
+  }
+  size_t v = 0;
+  for (size_t i = start; i < end; i++) {
+    if (s[i] < '0' || s[i] > '9') {
+      return false;
+    }
+    v = v * 10 + (s[i] - '0');
+  }
+  *value = v;
+  return true;
+}
+
+// Results of parseRange()
+enum {
+  RANGE_IGNORE,
+  RANGE_SATISFIABLE,
+  RANGE_NOT_SATISFIABLE
+};
+
+/**
+ * Parses a Range header with a single byte range like "bytes=0-499", "bytes=500-" or "bytes=-500".
+ * Sets [rangeStart, rangeEnd) on success. Invalid and multi-range headers are ignored, so the whole
+ * file is sent (RFC 7233, 3.1).
+ */
+static int parseRange(std::string const &range, size_t fileSize, size_t * rangeStart, size_t * rangeEnd) {
+  if (range.length() < 6 || strncasecmp(range.c_str(), "bytes=", 6) != 0 || range.find(',') != std::string::npos) {
+    return RANGE_IGNORE;
+  }
+  size_t dash = range.find('-', 6);
+  if (dash == std::string::npos) {
+    return RANGE_IGNORE;
+  }
+  size_t first, last;
+  bool hasFirst = parseRangeNumber(range, 6, dash, &first);
+  bool hasLast = parseRangeNumber(range, dash + 1, range.length(), &last);
+  if (!hasFirst && (dash != 6 || !hasLast)) {
+    return RANGE_IGNORE;
+  }
+  if (!hasFirst) {
+    // Suffix range: The last bytes of the file
+    if (last == 0 || fileSize == 0) {
+      return RANGE_NOT_SATISFIABLE;
+    }
+    *rangeStart = (last < fileSize) ? fileSize - last : 0;
+    *rangeEnd = fileSize;
+    return RANGE_SATISFIABLE;
+  }
+  if (dash + 1 < range.length() && !hasLast) {
+    return RANGE_IGNORE;
+  }
+  if (hasLast && last < first) {
+    return RANGE_IGNORE;
+  }
+  if (first >= fileSize) {
+    return RANGE_NOT_SATISFIABLE;
+  }
+  *rangeStart = first;
+  *rangeEnd = (hasLast && last < fileSize) ? last + 1 : fileSize;
+  return RANGE_SATISFIABLE;
+}
+
+/**
+ * Creates a strong entity tag for the file from its size and modification time. If the file system
+ * does not provide a modification time (like SPIFFS), a weak entity tag of the size is used, as
+ * hashing the content would require reading the whole file for every request.
+ */
+static std::string createEntityTag(StaticFile * file, bool gzipped) {
+  char etag[40];
+  time_t lastModified = file->getLastModified();
+  if (lastModified > 0) {
+    snprintf(etag, sizeof(etag), "\"%x-%08x%s\"", (unsigned int)file->size(), (unsigned int)lastModified, gzipped ? "-gz" : "");
+  } else {
+    snprintf(etag, sizeof(etag), "W/\"%x%s\"", (unsigned int)file->size(), gzipped ? "-gz" : "");
+  }
+  return std::string(etag);
+}
+
+/**
+ * Handler function for all StaticFileNodes. The node is taken from the request
+ */
+static void handleStaticFile(HTTPRequest * req, HTTPResponse * res) {
+  StaticFileNode * node = (StaticFileNode *)req->getResolvedNode();
+
+  if (req->getMethod() != "GET") {
+    req->discardRequestBody();
+    res->setStatusCode(405);
+    res->setStatusText("Method Not Allowed");
+    res->setHeader("Allow", "GET");
+    res->println("405 Method Not Allowed");
+    return;
+  }
+
+  // Map the request path (without query) to a file
+  std::string path = req->getRequestString();
+  size_t queryStart = path.find('?');
+  if (queryStart != std::string::npos) {
+    path.resize(queryStart);
+  }
+  path = urlDecode(path);
+  if (!path.empty() && path[path.length() - 1] == '/') {
+    path += node->_indexFile;
+  }
+
+  // Paths have to be absolute and must not leave the root directory
+  StaticFile * file = NULL;
+  bool gzipped = false;
+  bool hasGzipVariant = false;
+  if (!path.empty() && path[0] == '/' && path.find("..") == std::string::npos) {
+    StaticFile * gzipFile = node->_fileSystem->open(path + ".gz");
+    if (gzipFile != NULL) {
+      hasGzipVariant = true;
+      if (acceptsEncoding(req->getHeader(HEADER_ACCEPT_ENCODING), "gzip")) {
+        file = gzipFile;
+        gzipped = true;
+      } else {
+        delete gzipFile;
+      }
+    }
+    if (file == NULL) {
+      file = node->_fileSystem->open(path);
+    }
+  }
+
+  if (file == NULL) {
+    res->setStatusCode(404);
+    res->setStatusText("Not Found");
+    res->println("404 Not Found");
+    return;
+  }
+
+  size_t fileSize = file->size();
+  time_t lastModified = file->getLastModified();
+  std::string etag = createEntityTag(file, gzipped);
+  std::string lastModifiedDate = (lastModified > 0 ? formatHTTPDate(lastModified) : std::string());
+
+  res->setHeader(HEADER_CONTENT_TYPE, getContentType(path));
+  res->setHeader(HEADER_ETAG, etag);
+  if (lastModified > 0) {
+    res->setHeader(HEADER_LAST_MODIFIED, lastModifiedDate);
+  }
+  if (gzipped) {
+    res->setHeader(HEADER_CONTENT_ENCODING, "gzip");
+  }
+  if (hasGzipVariant) {
+    res->setHeader("Vary", "Accept-Encoding");
+  }
+  res->setHeader("Accept-Ranges", "bytes");
+
+  // Conditional requests: If-None-Match takes precedence over If-Modified-Since (RFC 7232, 3.3)
+  std::string ifNoneMatch = req->getHeader(HEADER_IF_NONE_MATCH);
+  bool notModified = false;
+  if (!ifNoneMatch.empty()) {
+    notModified = entityTagMatches(ifNoneMatch, etag);
+  } else if (lastModified > 0) {
+    time_t ifModifiedSince = parseHTTPDate(req->getHeader(HEADER_IF_MODIFIED_SINCE));
+    notModified = (ifModifiedSince > 0 && lastModified <= ifModifiedSince);
+  }
+  if (notModified) {
+    delete file;
+    res->sendNotModified();
+    return;
+  }
+
+  // Range requests. If-Range only allows the range if the client has the current version
+  size_t rangeStart = 0;
+  size_t rangeEnd = fileSize;
+  std::string range = req->getHeader(HEADER_RANGE);
+  std::string ifRange = req->getHeader("If-Range");
+  // Weak entity tags must not be used for If-Range (RFC 7233, 3.2)
+  if (!range.empty() && (ifRange.empty() || (lastModified > 0 && (ifRange == etag || ifRange == lastModifiedDate)))) {
+    int rangeResult = parseRange(range, fileSize, &rangeStart, &rangeEnd);
+    if (rangeResult == RANGE_NOT_SATISFIABLE) {
+      delete file;
+      res->setStatusCode(416);
+      res->setStatusText("Range Not Satisfiable");
+      res->setHeader("Content-Range", "bytes */" + intToString(fileSize));
+      res->setContentLength(0);
+      return;
+    }
+    if (rangeResult == RANGE_SATISFIABLE && (rangeStart == 0 || file->seek(rangeStart))) {
+      res->setStatusCode(206);
+      res->setStatusText("Partial Content");
+      res->setHeader("Content-Range", "bytes " + intToString(rangeStart) + "-" + intToString(rangeEnd - 1) + "/" + intToString(fileSize));
+    } else {
+      rangeStart = 0;
+      rangeEnd = fileSize;
+    }
+  }
+
+  // Stream the file through a fixed buffer
+  res->setContentLength(rangeEnd - rangeStart);
+  byte buffer[HTTPS_STATIC_FILE_BUFFER_SIZE];
+  size_t remaining = rangeEnd - rangeStart;
+  while (remaining > 0) {
+    size_t length = file->read(buffer, std::min(remaining, sizeof(buffer)));
+    if (length == 0 || res->write(buffer, length) != length) {
+      break;
+    }
+    remaining -= length;
+  }
+  delete file;
+
+  if (remaining > 0) {
+    // The client cannot tell that the body is incomplete unless the connection is closed
+    HTTPS_LOGW("Could not send the complete file %s", path.c_str());
+    res->setHeader(HEADER_CONNECTION, "close");
+  }
+}
+
+StaticFileNode::StaticFileNode(const std::string &path, StaticFileSystem * fileSystem, const std::string &tag):
+  ResourceNode(path, "GET", &handleStaticFile, tag),
+  _fileSystem(fileSystem),
+  _indexFile("index.html") {
+
+}
+
+StaticFileNode::~StaticFileNode() {
+
+}
+
+/**
+ * Sets the file that is served for paths ending with a slash, defaults to index.html
+ */
+void StaticFileNode::setIndexFile(std::string const &indexFile) {
+  _indexFile = indexFile;
+}
+
+} /* namespace httpsserver */
@@ -0,0 +1,40 @@
+#ifndef SRC_STATICFILENODE_HPP_
+#define SRC_STATICFILENODE_HPP_
+
+#include <string>
+
+#include "ResourceNode.hpp"
+#include "StaticFileSystem.hpp"
+
+namespace httpsserver {
+
+/**
+ * \brief This ResourceNode serves files from a StaticFileSystem for GET requests
+ *
+ * The request path is used as path in the file system (e.g. /css/style.css), paths that end with a
+ * slash are mapped to the index file. The node can be registered for a single path or be used as
+ * default node to serve all remaining paths. For each file:
+ *
+ * - If a precompressed variant exists (style.css.gz) and the client accepts gzip, that one is sent
+ * - An ETag and Last-Modified (if the file system provides it) are sent, requests with a matching
+ *   If-None-Match or If-Modified-Since are answered with 304 Not Modified. Without a modification
+ *   time, the ETag is a weak tag of the file size
+ * - A single range can be requested using the Range header
+ * - The file is sent with Content-Length through a buffer of HTTPS_STATIC_FILE_BUFFER_SIZE bytes
+ *
+ * The file system is not deleted with the node.
+ */
+class StaticFileNode : public ResourceNode {
+public:
+  StaticFileNode(const std::string &path, StaticFileSystem * fileSystem, const std::string &tag = "");
+  virtual ~StaticFileNode();
+
+  void setIndexFile(std::string const &indexFile);
+
+  StaticFileSystem * const _fileSystem;
+  std::string _indexFile;
+};
+
+} /* namespace httpsserver */
+
+#endif /* SRC_STATICFILENODE_HPP_ */
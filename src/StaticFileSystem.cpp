@@ -0,0 +1,76 @@
+#include "StaticFileSystem.hpp"
+
+#include <sys/stat.h>
+
+namespace httpsserver {
+
+StaticFile::~StaticFile() {
+
+}
+
+StaticFileSystem::~StaticFileSystem() {
+
+}
+
+/**
+ * \brief File of a POSIXStaticFileSystem
+ */
+class POSIXStaticFile : public StaticFile {
+public:
+  POSIXStaticFile(FILE * file, size_t size, time_t lastModified):
+    _file(file),
+    _size(size),
+    _lastModified(lastModified) {
+
+  }
+
+  virtual ~POSIXStaticFile() {
+    fclose(_file);
+  }
+
+  virtual size_t read(byte * buffer, size_t length) {
+    return fread(buffer, 1, length, _file);
+  }
+
+  virtual bool seek(size_t position) {
+    return fseek(_file, position, SEEK_SET) == 0;
+  }
+
+  virtual size_t size() {
+    return _size;
+  }
+
+  virtual time_t getLastModified() {
+    return _lastModified;
+  }
+
+private:
+  FILE * _file;
+  size_t _size;
+  time_t _lastModified;
+};
+
+POSIXStaticFileSystem::POSIXStaticFileSystem(std::string const &rootDirectory):
+  _rootDirectory(rootDirectory) {
+
+}
+
+POSIXStaticFileSystem::~POSIXStaticFileSystem() {
+
+}
+
+StaticFile * POSIXStaticFileSystem::open(std::string const &path) {
+  std::string fullPath = _rootDirectory + path;
+  FILE * file = fopen(fullPath.c_str(), "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  struct stat fileStat;
+  if (fstat(fileno(file), &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+    fclose(file);
+    return NULL;
+  }
+  return new POSIXStaticFile(file, fileStat.st_size, fileStat.st_mtime);
+}
+
+} /* namespace httpsserver */
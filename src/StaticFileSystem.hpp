@@ -0,0 +1,62 @@
+#ifndef SRC_STATICFILESYSTEM_HPP_
+#define SRC_STATICFILESYSTEM_HPP_
+
+#include <Arduino.h>
+
+#include <ctime>
+#include <cstdio>
+#include <string>
+
+namespace httpsserver {
+
+/**
+ * \brief A file that has been opened for reading by a StaticFileSystem
+ */
+class StaticFile {
+public:
+  virtual ~StaticFile();
+
+  /** Reads up to length bytes and returns the number of bytes read (0 at the end of the file) */
+  virtual size_t read(byte * buffer, size_t length) = 0;
+  /** Moves the read position, returns false if that is not possible */
+  virtual bool seek(size_t position) = 0;
+  /** Returns the size of the file in bytes */
+  virtual size_t size() = 0;
+  /** Returns the time of the last modification, or 0 if the file system does not provide it */
+  virtual time_t getLastModified() = 0;
+};
+
+/**
+ * \brief Read-only interface to a file system, used by StaticFileNode to serve files
+ *
+ * Use ArduinoStaticFileSystem for SPIFFS, LittleFS or SD, or POSIXStaticFileSystem for file systems
+ * that are accessible by fopen() (including the ESP-IDF VFS).
+ */
+class StaticFileSystem {
+public:
+  virtual ~StaticFileSystem();
+
+  /**
+   * Opens the file for reading. Returns NULL if it does not exist or is not a regular file.
+   * The caller has to delete the returned object.
+   */
+  virtual StaticFile * open(std::string const &path) = 0;
+};
+
+/**
+ * \brief StaticFileSystem based on fopen(). All paths are relative to the root directory
+ */
+class POSIXStaticFileSystem : public StaticFileSystem {
+public:
+  POSIXStaticFileSystem(std::string const &rootDirectory = "");
+  virtual ~POSIXStaticFileSystem();
+
+  virtual StaticFile * open(std::string const &path);
+
+private:
+  const std::string _rootDirectory;
+};
+
+} /* namespace httpsserver */
+
+#endif /* SRC_STATICFILESYSTEM_HPP_ */
@@ -0,0 +1,26 @@
+#include "StaticResourceNode.hpp"
+
+namespace httpsserver {
+
+/**
+ * Handler function for all StaticResourceNodes. The node is taken from the request
+ */
+static void handleStaticResource(HTTPRequest * req, HTTPResponse * res) {
+  StaticResourceNode * node = (StaticResourceNode *)req->getResolvedNode();
+  res->sendStatic(node->_data, node->_length, node->_contentType, node->_etag);
+}
+
+StaticResourceNode::StaticResourceNode(const std::string &path, const void * data, size_t length, const std::string &contentType, const std::string &etag, const std::string &tag):
+  ResourceNode(path, "GET", &handleStaticResource, tag),
+  _data(data),
+  _length(length),
+  _contentType(contentType),
+  _etag(etag) {
+
+}
+
+StaticResourceNode::~StaticResourceNode() {
+
+}
+
+} /* namespace httpsserver */
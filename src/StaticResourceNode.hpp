@@ -0,0 +1,29 @@
+#ifndef SRC_STATICRESOURCENODE_HPP_
+#define SRC_STATICRESOURCENODE_HPP_
+
+#include <string>
+
+#include "ResourceNode.hpp"
+
+namespace httpsserver {
+
+/**
+ * \brief This ResourceNode serves a constant block of memory (like an array in flash) for GET requests
+ *
+ * The data is sent using HTTPResponse::sendStatic(), so it is not copied and the connection can be
+ * kept alive. The data must stay valid as long as the node is registered.
+ */
+class StaticResourceNode : public ResourceNode {
+public:
+  StaticResourceNode(const std::string &path, const void * data, size_t length, const std::string &contentType, const std::string &etag = "", const std::string &tag = "");
+  virtual ~StaticResourceNode();
+
+  const void * _data;
+  const size_t _length;
+  const std::string _contentType;
+  const std::string _etag;
+};
+
+} /* namespace httpsserver */
+
+#endif /* SRC_STATICRESOURCENODE_HPP_ */
@@ -57,6 +57,136 @@ std::string intToString(int i) {
   return std::string(c);
 }
 
+bool headerHasToken(std::string const &headerValue, std::string const &token) {
+  size_t start = 0;
+  while (start < headerValue.length()) {
+    size_t end = headerValue.find(',', start);
+    if (end == std::string::npos) {
+      end = headerValue.length();
+    }
+    // Strip optional whitespace around the element
+    size_t first = start;
+    size_t last = end;
+    while (first < last && (headerValue[first] == ' ' || headerValue[first] == '\t')) first++;
+    while (last > first && (headerValue[last - 1] == ' ' || headerValue[last - 1] == '\t')) last--;
+    if (last - first == token.length() && strncasecmp(headerValue.c_str() + first, token.c_str(), token.length()) == 0) {
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
+
+bool entityTagMatches(std::string const &headerValue, std::string const &etag) {
+  // The weak comparison ignores the W/ prefix (RFC 7232, 2.3.2)
+  size_t tagStart = (etag.compare(0, 2, "W/") == 0 ? 2 : 0);
+  size_t tagLength = etag.length() - tagStart;
+  size_t start = 0;
+  while (start < headerValue.length()) {
+    size_t end = headerValue.find(',', start);
+    if (end == std::string::npos) {
+      end = headerValue.length();
+    }
+    size_t first = start;
+    size_t last = end;
+    while (first < last && (headerValue[first] == ' ' || headerValue[first] == '\t')) first++;
+    while (last > first && (headerValue[last - 1] == ' ' || headerValue[last - 1] == '\t')) last--;
+    if (last - first == 1 && headerValue[first] == '*') {
+      return true;
+    }
+    if (last - first >= 2 && headerValue.compare(first, 2, "W/") == 0) {
+      first += 2;
+    }
+    if (last - first == tagLength && headerValue.compare(first, tagLength, etag, tagStart, tagLength) == 0) {
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
+
+bool acceptsEncoding(std::string const &acceptEncoding, std::string const &coding) {
+  // -1: not listed, 0: not acceptable (q=0), 1: acceptable
+  int codingAccepted = -1;
+  int wildcardAccepted = -1;
+  size_t start = 0;
+  while (start < acceptEncoding.length()) {
+    size_t end = acceptEncoding.find(',', start);
+    if (end == std::string::npos) {
+      end = acceptEncoding.length();
+    }
+    // Split the element in the coding and its parameters, like: "gzip;q=0.5"
+    size_t paramStart = acceptEncoding.find(';', start);
+    if (paramStart == std::string::npos || paramStart > end) {
+      paramStart = end;
+    }
+    size_t first = start;
+    size_t last = paramStart;
+    while (first < last && (acceptEncoding[first] == ' ' || acceptEncoding[first] == '\t')) first++;
+    while (last > first && (acceptEncoding[last - 1] == ' ' || acceptEncoding[last - 1] == '\t')) last--;
+
+    // A quality value of 0 (or 0.0, 0.00, ...) means "not acceptable"
+    bool acceptable = true;
+    size_t q = acceptEncoding.find("q=", paramStart);
+    if (q != std::string::npos && q < end) {
+      acceptable = false;
+      for (size_t i = q + 2; i < end && acceptEncoding[i] != ' ' && acceptEncoding[i] != ';'; i++) {
+        if (acceptEncoding[i] >= '1' && acceptEncoding[i] <= '9') {
+          acceptable = true;
+        }
+      }
+    }
+
+    if (last - first == coding.length() && strncasecmp(acceptEncoding.c_str() + first, coding.c_str(), coding.length()) == 0) {
+      codingAccepted = acceptable ? 1 : 0;
+    } else if (last - first == 1 && acceptEncoding[first] == '*') {
+      wildcardAccepted = acceptable ? 1 : 0;
+    }
+    start = end + 1;
+  }
+  return codingAccepted == 1 || (codingAccepted == -1 && wildcardAccepted == 1);
+}
+
+std::string formatHTTPDate(time_t time) {
+  struct tm timeStruct;
+  gmtime_r(&time, &timeStruct);
+  char date[32];
+  size_t length = strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &timeStruct);
+  return std::string(date, length);
+}
+
+time_t parseHTTPDate(std::string const &date) {
+  static const char * const MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  int day, year, hour, minute, second;
+  char month[4];
+  if (sscanf(date.c_str(), "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &day, month, &year, &hour, &minute, &second) != 6) {
+    return 0;
+  }
+  const char * monthPos = strstr(MONTHS, month);
+  if (monthPos == NULL || strlen(month) != 3 || (monthPos - MONTHS) % 3 != 0 || year < 1970) {
+    return 0;
+  }
+  int m = (monthPos - MONTHS) / 3 + 1;
+
+  // Days since 1970-01-01 for the proleptic Gregorian calendar, without relying on timegm()
+  int y = year - (m <= 2 ? 1 : 0);
+  int era = y / 400;
+  int yearOfEra = y - era * 400;
+  int dayOfYear = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  long days = (long)era * 146097 + dayOfEra - 719468;
+
+  return (time_t)days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+uint32_t hashFNV1a(const void * data, size_t length, uint32_t hash) {
+  const byte * bytes = (const byte *)data;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
 }
 
 std::string urlDecode(std::string input) {
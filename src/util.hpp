@@ -4,6 +4,7 @@
 #include <Arduino.h>
 
 #include <cmath>
+#include <ctime>
 #include <string>
 
 namespace httpsserver {
@@ -25,6 +26,41 @@ int32_t parseInt(std::string const &s);
  */
 std::string intToString(int i);
 
+/**
+ * \brief **Utility function**: Check if a comma-separated header value (like Connection: a, b)
+ * contains the given token (case-insensitive)
+ */
+bool headerHasToken(std::string const &headerValue, std::string const &token);
+
+/**
+ * \brief **Utility function**: Check if an If-None-Match header value matches the entity tag
+ * (using the weak comparison, "*" matches every tag)
+ */
+bool entityTagMatches(std::string const &headerValue, std::string const &etag);
+
+/**
+ * \brief **Utility function**: Check if an Accept-Encoding header value allows the given content
+ * coding (like "gzip"), taking q=0 and "*" into account
+ */
+bool acceptsEncoding(std::string const &acceptEncoding, std::string const &coding);
+
+/**
+ * \brief **Utility function**: Format a timestamp as HTTP-date, like "Sun, 06 Nov 1994 08:49:37 GMT"
+ */
+std::string formatHTTPDate(time_t time);
+
+/**
+ * \brief **Utility function**: Parse an HTTP-date in the preferred format (see formatHTTPDate()).
+ * Returns 0 if the date cannot be parsed
+ */
+time_t parseHTTPDate(std::string const &date);
+
+/**
+ * \brief **Utility function**: 32 bit FNV-1a hash of the data. Data that is not available at once
+ * can be hashed by passing the result of the previous part as hash
+ */
+uint32_t hashFNV1a(const void * data, size_t length, uint32_t hash = 2166136261u);
+
 }
 
 /**